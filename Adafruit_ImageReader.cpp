@@ -37,22 +37,485 @@
  */
 
 #include "Adafruit_ImageReader.h"
+#include <new>
+#if defined(ESP32)
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_idf_version.h"
+#include "esp_partition.h"
+#endif
+
+// Buffers in BMP draw & load functions are allocated on the heap for each
+// call (or can be supplied by the application, see setBuffer() and
+// setAllocator()), sized to the image rather than a fixed pixel count on
+// the stack. BMP data is read a whole (clipped) scanline or more at a
+// time. Drawing to screen also requires two scanlines of 16-bit (565
+// color) pixels, alternated so that one can be converted while the other
+// is still being issued to the display by DMA. Loading to canvas needs no
+// interim 16-bit buffer as data goes straight to the canvas buffer.
+
+// Instrumentation for getStats(), compiled in only if IMAGEREADER_STATS
+// is defined; otherwise these expand to nothing (STAT_TIME to just its
+// statement) and cost nothing. 's' is an Adafruit_ImageStats.
+#if defined(IMAGEREADER_STATS)
+#define STAT_RESET(s) memset(&(s), 0, sizeof(s))
+#define STAT_ADD(s, field, n) ((s).field += (n))
+#define STAT_MAX(s, field, n)                                                 \
+  do {                                                                         \
+    if ((uint32_t)(n) > (s).field)                                             \
+      (s).field = (n);                                                         \
+  } while (0)
+#define STAT_START(t) uint32_t t = micros()
+#define STAT_SINCE(s, field, t) ((s).field += micros() - (t))
+#define STAT_TIME(s, field, stmt)                                             \
+  do {                                                                         \
+    uint32_t _t = micros();                                                    \
+    stmt;                                                                      \
+    (s).field += micros() - _t;                                                \
+  } while (0)
+#else
+#define STAT_RESET(s)
+#define STAT_ADD(s, field, n)
+#define STAT_MAX(s, field, n)
+#define STAT_START(t)
+#define STAT_SINCE(s, field, t)
+#define STAT_TIME(s, field, stmt) stmt
+#endif
+
+// ADAFRUIT_IMAGEALLOCATOR CLASS *******************************************
+// Where loaded images and working buffers are placed in memory. The base
+// class is the default: plain heap.
+
+static Adafruit_ImageAllocator heapAllocator; // Default for all readers
+
+/*!
+    @brief   Allocate memory for Adafruit_ImageReader or an image it loads.
+             Base class uses malloc().
+    @param   bytes
+             Size of request in bytes.
+    @param   use
+             What memory is for, an ImageMemory value.
+    @return  Pointer to memory (at least 32-bit aligned), or NULL if it
+             can't be allocated.
+*/
+void *Adafruit_ImageAllocator::alloc(size_t bytes, ImageMemory use) {
+  (void)use;
+  return malloc(bytes);
+}
+
+/*!
+    @brief   Free memory previously returned by alloc(). Base class uses
+             free().
+    @param   ptr
+             Pointer from alloc().
+    @param   use
+             Same ImageMemory value it was requested with.
+    @return  None (void).
+*/
+void Adafruit_ImageAllocator::release(void *ptr, ImageMemory use) {
+  (void)use;
+  free(ptr);
+}
 
-// Buffers in BMP draw function (to screen) require 5 bytes/pixel: 3 bytes
-// for each BMP pixel (R+G+B), 2 bytes for each TFT pixel (565 color).
-// Buffers in BMP load (to canvas) require 3 bytes/pixel (R+G+B from BMP),
-// no interim 16-bit buffer as data goes straight to the canvas buffer.
-// Because buffers are flushed at the end of each scanline (to allow for
-// cropping, vertical flip, scanline padding, etc.), no point in any of
-// these pixel counts being more than the screen width.
-// (Maybe to do: make non-AVR loader dynamically allocate buffer based
-// on screen or image size.)
-
-#ifdef __AVR__
-#define BUFPIXELS 24 ///<  24 * 5 =  120 bytes
+#if defined(ESP32)
+/*!
+    @brief   Allocate image memory in PSRAM, working buffers in DMA-capable
+             internal RAM.
+    @param   bytes
+             Size of request in bytes.
+    @param   use
+             What memory is for, an ImageMemory value.
+    @return  Pointer to memory, or NULL if it can't be allocated (canvases
+             and palettes are not placed in internal RAM if PSRAM is full
+             or not present).
+*/
+void *Adafruit_ImageAllocatorPSRAM::alloc(size_t bytes, ImageMemory use) {
+  if (use == IMAGE_MEM_WORK) // Scanlines may be issued to display by DMA
+    return heap_caps_malloc(bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL |
+                                       MALLOC_CAP_8BIT);
+  return heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+}
+
+/*!
+    @brief   Free memory previously returned by alloc().
+    @param   ptr
+             Pointer from alloc().
+    @param   use
+             Same ImageMemory value it was requested with.
+    @return  None (void).
+*/
+void Adafruit_ImageAllocatorPSRAM::release(void *ptr, ImageMemory use) {
+  (void)use;
+  heap_caps_free(ptr);
+}
+#endif
+
+// ADAFRUIT_IMAGESOURCE CLASSES ********************************************
+// Where BMP data comes from when not a file opened by name: another File,
+// memory, or a forward-only Stream.
+
+// Read len bytes from file into buf, return number read.
+static int bmpRead(File &file, uint8_t *buf, uint32_t len) {
+#if defined(ARDUINO_NRF52_ADAFRUIT)
+  // NRF52840 seems to have trouble reading more than 512
+  // bytes across certain boundaries. Workaround for now
+  // is to break the read into smaller chunks...
+  int32_t bytesToGo = len, bytesRead = 0, bytesThisPass;
+  while (bytesToGo > 0) {
+    bytesThisPass = min(bytesToGo, 512);
+    if ((bytesThisPass = file.read(&buf[bytesRead], bytesThisPass)) <= 0)
+      break;
+    bytesRead += bytesThisPass;
+    bytesToGo -= bytesThisPass;
+  }
+  return bytesRead;
 #else
-#define BUFPIXELS 200 ///< 200 * 5 = 1000 bytes
+  return file.read(buf, len);
 #endif
+}
+
+/*!
+    @brief   Read bytes from file.
+    @param   buf
+             Destination.
+    @param   len
+             Number of bytes requested.
+    @return  Number of bytes read.
+*/
+int Adafruit_ImageFile::read(uint8_t *buf, uint32_t len) {
+  return bmpRead(file, buf, len);
+}
+
+/*!
+    @brief   Seek to position in file.
+    @param   pos
+             Byte offset from start of file.
+    @return  true on success.
+*/
+boolean Adafruit_ImageFile::seek(uint32_t pos) { return file.seek(pos); }
+
+/*!
+    @brief   Return position in file.
+    @return  Byte offset from start of file.
+*/
+uint32_t Adafruit_ImageFile::position(void) { return file.position(); }
+
+/*!
+    @brief   Copy bytes from memory.
+    @param   buf
+             Destination.
+    @param   len
+             Number of bytes requested.
+    @return  Number of bytes copied, less than len at end of data.
+*/
+int Adafruit_ImageMemory::read(uint8_t *buf, uint32_t len) {
+  if (len > (this->len - pos))
+    len = this->len - pos;
+  memcpy(buf, &data[pos], len);
+  pos += len;
+  return len;
+}
+
+/*!
+    @brief   Move to position in memory.
+    @param   pos
+             Byte offset from start of data.
+    @return  true on success, false if past end of data.
+*/
+boolean Adafruit_ImageMemory::seek(uint32_t pos) {
+  if (pos > len)
+    return false;
+  this->pos = pos;
+  return true;
+}
+
+/*!
+    @brief   Read bytes from stream, waiting (up to the stream's timeout)
+             for them to arrive.
+    @param   buf
+             Destination.
+    @param   len
+             Number of bytes requested.
+    @return  Number of bytes read, less than len on timeout.
+*/
+int Adafruit_ImageStream::read(uint8_t *buf, uint32_t len) {
+  size_t n = stream.readBytes((char *)buf, len);
+  pos += n;
+  return n;
+}
+
+/*!
+    @brief   Skip forward in stream, discarding data.
+    @param   pos
+             Byte offset from start of stream.
+    @return  true on success, false if backward (data is gone) or if the
+             stream times out.
+*/
+boolean Adafruit_ImageStream::seek(uint32_t pos) {
+  uint8_t buf[32];
+  while (this->pos < pos) {
+    uint32_t n = pos - this->pos;
+    if (read(buf, (n < sizeof buf) ? n : sizeof buf) <= 0)
+      return false;
+  }
+  return this->pos == pos;
+}
+
+// ADAFRUIT_IMAGEPACK CLASS ************************************************
+// Many images in one file, see openPack() for layout. The index (entry
+// records, then names) is read into RAM as-is; multi-byte values in it
+// are little-endian and decoded as needed.
+
+#define PACK_HEADER 16 // Bytes in pack file header
+#define PACK_ENTRY 12  // Bytes per index entry
+
+// Little-endian 32-bit value at p
+static inline uint32_t le32(const uint8_t *p) {
+  return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+/*!
+    @brief   Constructor.
+    @return  'Empty' Adafruit_ImagePack object, see ImageReader.openPack().
+*/
+Adafruit_ImagePack::Adafruit_ImagePack(void) : index(NULL) { close(); }
+
+/*!
+    @brief   Destructor.
+    @return  None (void).
+*/
+Adafruit_ImagePack::~Adafruit_ImagePack(void) { close(); }
+
+/*!
+    @brief   Closes pack file (if open) and frees its index.
+    @return  None (void).
+*/
+void Adafruit_ImagePack::close(void) {
+  if (file)
+    file.close();
+  if (index) {
+    free(index);
+    index = NULL;
+  }
+  entries = 0;
+  base = entrySize = pos = 0;
+  format = IMAGE_PACK_OTHER;
+}
+
+/*!
+    @brief   Look up an image in the pack's index (binary search).
+    @param   name
+             Image name, as stored by imagepack.py (file name, relative to
+             the directory given to it, without leading slash).
+    @return  Index of image (0 to count()-1), or -1 if not in pack.
+*/
+int32_t Adafruit_ImagePack::find(const char *name) const {
+  const char *names = (const char *)&index[entries * PACK_ENTRY];
+  int32_t lo = 0, hi = entries - 1;
+  while (lo <= hi) {
+    int32_t mid = (lo + hi) / 2;
+    const uint8_t *e = &index[mid * PACK_ENTRY];
+    int c = strcmp(name, &names[e[8] | (e[9] << 8)]);
+    if (!c)
+      return mid;
+    if (c < 0)
+      hi = mid - 1;
+    else
+      lo = mid + 1;
+  }
+  return -1;
+}
+
+/*!
+    @brief   Select image by name, to be read by the next drawBMP(),
+             loadBMP() or drawRAW() of this pack.
+    @param   name
+             Image name, see find().
+    @return  true on success, false if not in pack (selection is then
+             cleared).
+*/
+boolean Adafruit_ImagePack::select(const char *name) {
+  int32_t i = find(name);
+  if (i >= 0)
+    return select((uint16_t)i);
+  entrySize = pos = 0;
+  format = IMAGE_PACK_OTHER;
+  return false;
+}
+
+/*!
+    @brief   Select image by position in index, e.g. to step through all
+             images in a pack (in name order).
+    @param   index
+             Index of image, 0 to count()-1.
+    @return  true on success, false if out of range (selection is then
+             cleared).
+*/
+boolean Adafruit_ImagePack::select(uint16_t index) {
+  pos = 0;
+  if (index >= entries) {
+    entrySize = 0;
+    format = IMAGE_PACK_OTHER;
+    return false;
+  }
+  const uint8_t *e = &this->index[index * PACK_ENTRY];
+  base = le32(e);
+  entrySize = le32(&e[4]);
+  format = (e[10] <= IMAGE_PACK_RAW) ? (ImagePackFormat)e[10]
+                                     : IMAGE_PACK_OTHER;
+  return true;
+}
+
+/*!
+    @brief   Return name of image at position in index.
+    @param   index
+             Index of image, 0 to count()-1.
+    @return  Name (in pack's index, valid until it's closed), or NULL if
+             out of range.
+*/
+const char *Adafruit_ImagePack::name(uint16_t index) const {
+  if (index >= entries)
+    return NULL;
+  const uint8_t *e = &this->index[index * PACK_ENTRY];
+  const char *names = (const char *)&this->index[entries * PACK_ENTRY];
+  return &names[e[8] | (e[9] << 8)];
+}
+
+/*!
+    @brief   Read bytes of selected image.
+    @param   buf
+             Destination.
+    @param   len
+             Number of bytes requested.
+    @return  Number of bytes read, less than len at end of image.
+*/
+int Adafruit_ImagePack::read(uint8_t *buf, uint32_t len) {
+  if (len > (entrySize - pos))
+    len = entrySize - pos;
+  if (!len)
+    return 0;
+  if (file.position() != (base + pos)) // File is only seeked when read
+    file.seek(base + pos);
+  int n = bmpRead(file, buf, len);
+  if (n <= 0)
+    return 0;
+  pos += n;
+  return n;
+}
+
+/*!
+    @brief   Move to position within selected image.
+    @param   pos
+             Byte offset from start of image.
+    @return  true on success, false if past end of image.
+*/
+boolean Adafruit_ImagePack::seek(uint32_t pos) {
+  if (pos > entrySize)
+    return false;
+  this->pos = pos;
+  return true;
+}
+
+// GFX canvas using a pixel buffer from an Adafruit_ImageAllocator rather
+// than its own malloc() (needs the allocate_buffer argument of Adafruit_GFX
+// 1.11 or later). Adds no members, so it's destroyed as its base class.
+template <class C, typename T> class ImageCanvas : public C {
+public:
+  ImageCanvas(uint16_t w, uint16_t h, T *buf) : C(w, h, false) {
+    this->buffer = buf;
+  }
+};
+
+// Create GFX canvas type C (pixel type T, 'bytes' of pixel data) with
+// allocator. Canvas object and its pixels share one allocation.
+template <class C, typename T>
+static C *newCanvas(Adafruit_ImageAllocator *allocator, uint16_t w,
+                    uint16_t h, uint32_t bytes) {
+  uint32_t head = (sizeof(ImageCanvas<C, T>) + 7) & ~7;
+  uint8_t *mem = (uint8_t *)allocator->alloc(head + bytes, IMAGE_MEM_PIXELS);
+  return mem ? new (mem) ImageCanvas<C, T>(w, h, (T *)&mem[head]) : NULL;
+}
+
+// Destroy canvas from newCanvas()
+template <class C>
+static void deleteCanvas(Adafruit_ImageAllocator *allocator, C *canvas) {
+  canvas->~C();
+  allocator->release(canvas, IMAGE_MEM_PIXELS);
+}
+
+// Clip image (width & height in w & h) at screen position x & y to screen
+// bounds. On return, x & y are the top-left screen position drawn to,
+// loadX & loadY the first image column & row drawn, and w & h the size
+// of the region drawn (0 or less if none).
+static void clipToScreen(Adafruit_SPITFT &tft, int16_t &x, int16_t &y,
+                         int &loadX, int &loadY, int &w, int &h) {
+  loadX = loadY = 0;
+  if (x < 0) {
+    loadX = -x;
+    w += x;
+    x = 0;
+  }
+  if (y < 0) {
+    loadY = -y;
+    h += y;
+    y = 0;
+  }
+  if ((x + w) > tft.width())
+    w = tft.width() - x;
+  if ((y + h) > tft.height())
+    h = tft.height() - y;
+}
+
+// ADAFRUIT_IMAGESINKGFX CLASS *********************************************
+// Scanlines from drawBMP(filename, sink, ...) to any GFX display or
+// canvas, through its own drawRGBBitmap() (clipped again there, so no
+// harm if the GFX object's rotation changes).
+
+/*!
+    @brief   Constructor.
+    @param   gfx
+             Adafruit_GFX object (display or canvas) to draw to. It must
+             outlive the sink.
+    @return  Adafruit_ImageSinkGFX object, pass to ImageReader.drawBMP().
+*/
+Adafruit_ImageSinkGFX::Adafruit_ImageSinkGFX(Adafruit_GFX &gfx) : gfx(gfx) {}
+
+/*!
+    @brief   Return width of GFX object (as rotated).
+    @return  Width in pixels.
+*/
+int16_t Adafruit_ImageSinkGFX::width(void) { return gfx.width(); }
+
+/*!
+    @brief   Return height of GFX object (as rotated).
+    @return  Height in pixels.
+*/
+int16_t Adafruit_ImageSinkGFX::height(void) { return gfx.height(); }
+
+/*!
+    @brief   Draw one scanline to GFX object, see Adafruit_ImageSink.
+    @param   x       Horizontal position of first pixel.
+    @param   y       Vertical position of scanline.
+    @param   pixels  565 pixels.
+    @param   count   Number of pixels.
+    @param   format  Pixel format.
+    @return  None (void).
+*/
+void Adafruit_ImageSinkGFX::row(int16_t x, int16_t y, const uint16_t *pixels,
+                                int16_t count, ImageSinkFormat format) {
+  if (format == IMAGE_SINK_565) {
+    gfx.drawRGBBitmap(x, y, (uint16_t *)pixels, count, 1);
+  } else { // Swap each pixel on the way out (buffer isn't ours to change)
+    gfx.startWrite();
+    for (int16_t i = 0; i < count; i++)
+      gfx.writePixel(x + i, y, (pixels[i] >> 8) | (pixels[i] << 8));
+    gfx.endWrite();
+  }
+}
 
 // ADAFRUIT_IMAGE CLASS ****************************************************
 // This has been created as a class here rather than in Adafruit_GFX because
@@ -65,16 +528,66 @@
     @return  'Empty' Adafruit_Image object.
 */
 Adafruit_Image::Adafruit_Image(void)
-    : mask(NULL), palette(NULL), format(IMAGE_NONE) {
+    : mask(NULL), palette(NULL), allocator(&heapAllocator), colors(0),
+      format(IMAGE_NONE) {
   canvas.canvas1 = NULL;
 }
 
+/*!
+    @brief   Move constructor. Takes over another image's canvas, palette
+             and mask, without copying or re-loading; the other image is
+             left empty.
+    @param   other
+             Adafruit_Image to move from.
+    @return  Adafruit_Image object with the other's contents.
+*/
+Adafruit_Image::Adafruit_Image(Adafruit_Image &&other)
+    : canvas(other.canvas), mask(other.mask), palette(other.palette),
+      allocator(other.allocator), colors(other.colors), format(other.format) {
+  other.release();
+}
+
+/*!
+    @brief   Move assignment. Frees this image's contents, then takes over
+             another image's canvas, palette and mask; the other image is
+             left empty.
+    @param   other
+             Adafruit_Image to move from.
+    @return  Reference to this image.
+*/
+Adafruit_Image &Adafruit_Image::operator=(Adafruit_Image &&other) {
+  if (this != &other) {
+    dealloc();
+    canvas = other.canvas;
+    mask = other.mask;
+    palette = other.palette;
+    allocator = other.allocator;
+    colors = other.colors;
+    format = other.format;
+    other.release();
+  }
+  return *this;
+}
+
 /*!
     @brief   Destructor.
     @return  None (void).
 */
 Adafruit_Image::~Adafruit_Image(void) { dealloc(); }
 
+/*!
+    @brief   Resets member variables to 'empty' state without freeing
+             anything (contents have been moved to another image).
+    @return  None (void).
+*/
+void Adafruit_Image::release(void) {
+  canvas.canvas1 = NULL;
+  mask = NULL;
+  palette = NULL;
+  colors = 0;
+  format = IMAGE_NONE;
+}
+
 /*!
     @brief   Deallocates memory associated with Adafruit_Image object
              and resets member variables to 'empty' state.
@@ -83,28 +596,29 @@ Adafruit_Image::~Adafruit_Image(void) { dealloc(); }
 void Adafruit_Image::dealloc(void) {
   if (format == IMAGE_1) {
     if (canvas.canvas1) {
-      delete canvas.canvas1;
+      deleteCanvas(allocator, canvas.canvas1);
       canvas.canvas1 = NULL;
     }
   } else if (format == IMAGE_8) {
     if (canvas.canvas8) {
-      delete canvas.canvas8;
+      deleteCanvas(allocator, canvas.canvas8);
       canvas.canvas8 = NULL;
     }
   } else if (format == IMAGE_16) {
     if (canvas.canvas16) {
-      delete canvas.canvas16;
+      deleteCanvas(allocator, canvas.canvas16);
       canvas.canvas16 = NULL;
     }
   }
   if (mask) {
-    delete mask;
+    deleteCanvas(allocator, mask);
     mask = NULL;
   }
   if (palette) {
-    delete[] palette;
+    allocator->release(palette, IMAGE_MEM_PALETTE);
     palette = NULL;
   }
+  colors = 0;
   format = IMAGE_NONE;
 }
 
@@ -140,6 +654,23 @@ int16_t Adafruit_Image::height(void) const {
   return 0;
 }
 
+/*!
+    @brief   Get RAM used by Adafruit_Image object's pixels and palette.
+    @return  Size in bytes, or 0 if no image loaded.
+*/
+uint32_t Adafruit_Image::size(void) const {
+  uint32_t w = width(), h = height(), bytes = colors * sizeof(uint16_t);
+  if (format == IMAGE_1)
+    bytes += ((w + 7) / 8) * h;
+  else if (format == IMAGE_8)
+    bytes += w * h;
+  else if (format == IMAGE_16)
+    bytes += w * h * 2;
+  if (mask)
+    bytes += ((mask->width() + 7) / 8) * mask->height();
+  return bytes;
+}
+
 /*!
     @brief   Return pointer to image's GFX canvas object.
     @return  void* pointer, must be type-converted to a GFX canvas type
@@ -181,22 +712,302 @@ void *Adafruit_Image::getCanvas(void) const {
     @return  None (void).
 */
 void Adafruit_Image::draw(Adafruit_SPITFT &tft, int16_t x, int16_t y) {
-  if (format == IMAGE_1) {
-    uint16_t foreground, background;
-    if (palette) {
-      foreground = palette[1];
-      background = palette[0];
+  draw(tft, x, y, 0, 0, width(), height());
+}
+
+/*!
+    @brief   Draw a rectangular section of image to an Adafruit_SPITFT-type
+             display, e.g. the visible part of a map or panorama larger
+             than the screen, or to repaint just a damaged region. Only
+             the part of the section that's on screen is issued, with one
+             address window for the whole of it.
+    @param   tft
+             Screen to draw to (any Adafruit_SPITFT-derived class).
+    @param   x
+             Horizontal screen position of the section's left edge.
+             Value is signed, section will be clipped if all or part is
+             off the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical screen position of the section's top edge.
+    @param   srcX
+             Left edge of section within image.
+    @param   srcY
+             Top edge of section within image.
+    @param   srcW
+             Width of section, clipped to image bounds.
+    @param   srcH
+             Height of section, clipped to image bounds.
+    @return  None (void).
+*/
+void Adafruit_Image::draw(Adafruit_SPITFT &tft, int16_t x, int16_t y,
+                          int16_t srcX, int16_t srcY, int16_t srcW,
+                          int16_t srcH) {
+  if ((format == IMAGE_NONE) || ((format == IMAGE_8) && !palette))
+    return; // Nothing loaded (loadBMP() always provides an 8-bit palette)
+
+  // Clip section to image bounds (if clipped on the left or top, the
+  // screen position moves to match, as with drawBMP()), then to screen.
+  // Each drawn scanline is then loadX,loadY onward in the canvas.
+  int imgW = width(), imgH = height(), w, h, loadX, loadY;
+  if (srcX < 0) {
+    srcW += srcX;
+    x -= srcX;
+    srcX = 0;
+  }
+  if (srcY < 0) {
+    srcH += srcY;
+    y -= srcY;
+    srcY = 0;
+  }
+  w = ((srcX + srcW) > imgW) ? (imgW - srcX) : srcW;
+  h = ((srcY + srcH) > imgH) ? (imgH - srcY) : srcH;
+  if ((w <= 0) || (h <= 0))
+    return;
+  clipToScreen(tft, x, y, loadX, loadY, w, h);
+  if ((w <= 0) || (h <= 0))
+    return;
+  loadX += srcX;
+  loadY += srcY;
+
+  if ((format == IMAGE_16) && !mask) {
+    // 16-bit canvas is already 565, issued straight from the canvas,
+    // a scanline per write (or all at once if not cropped horizontally).
+    uint16_t *src = &canvas.canvas16->getBuffer()[loadY * imgW + loadX];
+    tft.startWrite();
+    tft.setAddrWindow(x, y, w, h);
+    if (w == imgW) {
+      tft.writePixels(src, w * h, false);
     } else {
-      foreground = 0xFFFF;
-      background = 0x0000;
+      for (int row = 0; row < h; row++, src += imgW)
+        tft.writePixels(src, w, false);
     }
-    tft.drawBitmap(x, y, canvas.canvas1->getBuffer(), canvas.canvas1->width(),
-                   canvas.canvas1->height(), foreground, background);
-  } else if (format == IMAGE_8) {
+    tft.dmaWait(); // Let last DMA transfer finish, then
+    tft.endWrite(); // end TFT SPI transaction
   } else if (format == IMAGE_16) {
-    tft.drawRGBBitmap(x, y, canvas.canvas16->getBuffer(),
-                      canvas.canvas16->width(), canvas.canvas16->height());
+    // Masked: each scanline's runs of opaque pixels (set mask bits) are
+    // issued straight from the canvas, one address window and write per
+    // run, all in one SPI transaction. Transparent pixels aren't
+    // touched, so whatever's behind shows through. Mask bytes that are
+    // all clear or all set are skipped over whole.
+    int maskStride = (imgW + 7) / 8;
+    uint16_t *src = &canvas.canvas16->getBuffer()[loadY * imgW + loadX];
+    uint8_t *bits = &mask->getBuffer()[loadY * maskStride];
+    tft.startWrite();
+    for (int row = 0; row < h; row++, src += imgW, bits += maskStride) {
+      int col = 0;
+      while (col < w) {
+        // Skip transparent pixels
+        while (col < w) {
+          int bx = loadX + col;
+          if (!(bx & 7) && !bits[bx >> 3])
+            col += 8;
+          else if (!(bits[bx >> 3] & (0x80 >> (bx & 7))))
+            col++;
+          else
+            break;
+        }
+        if (col >= w)
+          break;
+        int start = col; // First opaque pixel, find end of run
+        while (col < w) {
+          int bx = loadX + col;
+          if (!(bx & 7) && (bits[bx >> 3] == 0xFF))
+            col += 8;
+          else if (bits[bx >> 3] & (0x80 >> (bx & 7)))
+            col++;
+          else
+            break;
+        }
+        if (col > w)
+          col = w;
+        tft.dmaWait(); // Previous run must be out before moving window
+        tft.setAddrWindow(x + start, y + row, col - start, 1);
+        tft.writePixels(&src[start], col - start, false);
+      }
+    }
+    tft.dmaWait(); // Let last DMA transfer finish, then
+    tft.endWrite(); // end TFT SPI transaction
+  } else {
+    // 8- and 1-bit: palette indices are expanded to 16-bit color a
+    // scanline at a time and issued in one SPI transaction (two
+    // alternating scanlines, so one can be expanded while the other is
+    // going out by DMA). If there's no RAM for the scanlines, it's done
+    // a pixel at a time instead (slowly, but it does work). 1-bit images
+    // without a palette are white on black.
+    const uint8_t *src;
+    uint32_t stride;
+    uint16_t lut[2] = {0x0000, 0xFFFF};
+    if (format == IMAGE_8) {
+      stride = imgW;
+      src = &canvas.canvas8->getBuffer()[loadY * stride];
+    } else {
+      stride = (imgW + 7) / 8;
+      src = &canvas.canvas1->getBuffer()[loadY * stride];
+      if (palette) {
+        lut[0] = palette[0];
+        lut[1] = palette[1];
+      }
+    }
+    uint16_t *line = (uint16_t *)allocator->alloc(w * 2 * sizeof(uint16_t),
+                                                  IMAGE_MEM_WORK);
+    tft.startWrite();
+    if (line)
+      tft.setAddrWindow(x, y, w, h);
+    for (int row = 0; row < h; row++, src += stride) {
+      if (!line) { // No scanline RAM, a pixel at a time
+        for (int col = 0, bx = loadX; col < w; col++, bx++)
+          tft.writePixel(x + col, y + row,
+                         (format == IMAGE_8)
+                             ? palette[src[bx]]
+                             : lut[(src[bx >> 3] >> (7 - (bx & 7))) & 1]);
+        continue;
+      }
+      // The scanline being expanded into was issued two writes ago,
+      // and SPITFT won't start a DMA transfer until the prior one is
+      // done, so it's free.
+      uint16_t *dest = &line[(row & 1) * w];
+      if (format == IMAGE_8) {
+        for (int col = 0; col < w; col++)
+          dest[col] = palette[src[loadX + col]];
+      } else {
+        for (int col = 0, bx = loadX; col < w; col++, bx++)
+          dest[col] = lut[(src[bx >> 3] >> (7 - (bx & 7))) & 1];
+      }
+      tft.writePixels(dest, w, false);
+    }
+    if (line) {
+      tft.dmaWait(); // Let last DMA transfer finish before freeing
+      allocator->release(line, IMAGE_MEM_WORK);
+    }
+    tft.endWrite();
+  }
+}
+
+// ADAFRUIT_BMPINFO CLASS **************************************************
+// Parsed BMP header (and optionally the open file) from ImageReader's
+// openBMP(), so an image can be drawn or loaded repeatedly without
+// re-opening and re-parsing each time.
+
+/*!
+    @brief   Constructor.
+    @return  'Empty' Adafruit_BMPInfo object, see Adafruit_ImageReader's
+             openBMP() function.
+*/
+Adafruit_BMPInfo::Adafruit_BMPInfo(void) : filename(NULL), palette(NULL) {
+  close();
+}
+
+/*!
+    @brief   Destructor.
+    @return  None (void).
+*/
+Adafruit_BMPInfo::~Adafruit_BMPInfo(void) { close(); }
+
+/*!
+    @brief   Closes file (if open) and frees memory associated with
+             Adafruit_BMPInfo object, resetting it to 'empty' state.
+    @return  None (void).
+*/
+void Adafruit_BMPInfo::close(void) {
+  if (file)
+    file.close();
+  source = NULL; // Not owned, just forgotten
+  if (filename) {
+    free(filename);
+    filename = NULL;
   }
+  if (palette) {
+    free(palette);
+    palette = NULL;
+  }
+  offset = 0;
+  rowSize = 0;
+  bmpWidth = 0;
+  bmpHeight = 0;
+  colors = 0;
+  depth = 0;
+  compression = 0;
+  rgb565 = false;
+  alpha = false;
+  flip = true;
+}
+
+// ADAFRUIT_BMPDRAW CLASS **************************************************
+// Incremental drawBMP(), see ImageReader's beginDraw(). The draw is set up
+// once (buffers, decoder, address window) and each step resumes decoding
+// where the last one ended, so every scanline is read once in all.
+
+/*!
+    @brief   Constructor.
+    @return  'Empty' Adafruit_BMPDraw object, see Adafruit_ImageReader's
+             beginDraw() function.
+*/
+Adafruit_BMPDraw::Adafruit_BMPDraw(void)
+    : reader(NULL), core(NULL), row(0), rows(0), status(IMAGE_SUCCESS) {}
+
+/*!
+    @brief   Destructor. Ends any draw in progress, see cancel().
+*/
+Adafruit_BMPDraw::~Adafruit_BMPDraw(void) { cancel(); }
+
+/*!
+    @brief   Draw next rows of image.
+    @param   n
+             Number of rows to draw (at least 1), fewer if near the end.
+             Each call continues from the previous one's file position and
+             decoder state (compressed images included), the only cost
+             per step is starting and ending one TFT write and setting
+             its address window. Compressed (RLE) BMPs are drawn from the
+             bottom row up.
+    @return  One of the ImageReturnCode values: IMAGE_SUCCESS if rows were
+             drawn (or image is done), other values on failure, which ends
+             the draw.
+*/
+ImageReturnCode Adafruit_BMPDraw::step(uint16_t n) {
+  if (done())
+    return status;
+  if (!n)
+    n = 1;
+  if (n > (rows - row))
+    n = rows - row;
+  int16_t count;
+  status = reader->stepBMP(core, n, NULL, &count);
+  row += count;
+  if ((status != IMAGE_SUCCESS) || !count || (row >= rows))
+    cancel();
+  return status;
+}
+
+/*!
+    @brief   Draw rows of image until a time budget is used up (or image is
+             done), for bounded-latency drawing in a busy main loop.
+    @param   us
+             Time budget in microseconds. Rows are drawn a few at a time
+             (the reader's setBufferRows() value), and at least once per
+             call, so a step may run over by the time it takes to draw
+             that many rows.
+    @return  One of the ImageReturnCode values: IMAGE_SUCCESS if rows were
+             drawn (or image is done), other values on failure, which ends
+             the draw.
+*/
+ImageReturnCode Adafruit_BMPDraw::stepMicros(uint32_t us) {
+  uint32_t start = micros();
+  do {
+    step(reader ? reader->bufRows : 1);
+  } while (!done() && ((uint32_t)(micros() - start) < us));
+  return status;
+}
+
+/*!
+    @brief   End drawing before image is done, freeing decoder state and
+             closing file. done() will then return true.
+    @return  None (void).
+*/
+void Adafruit_BMPDraw::cancel(void) {
+  if (core)
+    reader->endBMP(core);
+  bmp.close();
+  row = rows;
 }
 
 // ADAFRUIT_IMAGEREADER CLASS **********************************************
@@ -214,51 +1025,1054 @@ void Adafruit_Image::draw(Adafruit_SPITFT &tft, int16_t x, int16_t y) {
              often be in pre-setup() declaration, but DOES need initializing
              before any of the image loading or size functions are called!
 */
-Adafruit_ImageReader::Adafruit_ImageReader(fs::SPIFFSFS &fs) { filesys = &fs; }
+Adafruit_ImageReader::Adafruit_ImageReader(fs::SPIFFSFS &fs) {
+  filesys = &fs;
+  userBuf = NULL; // Working buffer is allocated per call unless set
+  userBufLen = 0;
+  bufRows = 1;
+  allocator = &heapAllocator;
+  reuseCanvas = false;
+  scaleShift = 0; // Full size
+  scaleAvg = false;
+  memset(&stats, 0, sizeof stats);
+#if defined(ESP32)
+  pipeCore = -1; // Pipelined drawBMP() is off until requested
+  pipeDepth = 4;
+  mapped = false;
+  prefetchSem = NULL; // Created on first prefetchBMP()
+  prefetching = false;
+  prefetchStop = false;
+  prefetchStatus = IMAGE_SUCCESS;
+  prefetchName = NULL;
+#endif
+}
 
 /*!
     @brief   Destructor.
     @return  None (void).
 */
 Adafruit_ImageReader::~Adafruit_ImageReader(void) {
-  if (file)
-    file.close();
   // filesystem is left as-is
+#if defined(ESP32)
+  cancelPrefetch(); // Task must be gone before reader is
+  if (prefetchSem)
+    vSemaphoreDelete((SemaphoreHandle_t)prefetchSem);
+  unmapPartition();
+#endif
 }
 
+#if defined(ESP32)
 /*!
-    @brief   Loads BMP image file from SD card directly to SPITFT screen.
-    @param   filename
-             Name of BMP image file to load.
-    @param   tft
-             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
-             displays that subclass Adafruit_SPITFT).
-    @param   x
-             Horizontal offset in pixels; left edge = 0, positive = right.
-             Value is signed, image will be clipped if all or part is off
-             the screen edges. Screen rotation setting is observed.
-    @param   y
-             Vertical offset in pixels; top edge = 0, positive = down.
-    @param   transact
-             Pass 'true' if TFT and SD are on the same SPI bus, in which
-             case SPI transactions are necessary. If separate peripherals,
-             can pass 'false'.
-    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
-             completion, other values on failure).
+    @brief   Enable or disable pipelined drawBMP() on dual-core ESP32.
+             When enabled, a FreeRTOS task pinned to the requested core
+             reads scanlines from the file into a ring of buffers, while
+             the calling core converts them and issues them to the
+             display, so filesystem reads and SPI writes overlap. Only
+             drawBMP() is affected; loadBMP() does not use the pipeline.
+    @param   core
+             Core (0 or 1) on which to run the file-reading task, or -1
+             to disable the pipeline (default). Usually this is the core
+             NOT running the Arduino loop, i.e. 0 (see xPortGetCoreID()).
+    @param   depth
+             Number of scanline buffers in the ring (2 minimum). Each is
+             the width of the image (as clipped) times 3 bytes, allocated
+             on the heap for the duration of a drawBMP() call. If the ring
+             or the task can't be allocated, drawBMP() falls back on the
+             normal single-core method.
+    @return  None (void).
+    @note    The reader task and the display are not synchronized for
+             bus sharing; the 'transact' argument to drawBMP() is ignored
+             when pipelined. This is fine for SPIFFS (on-chip flash is not
+             on the display's SPI bus).
 */
-ImageReturnCode Adafruit_ImageReader::drawBMP(char *filename,
-                                              Adafruit_SPITFT &tft, int16_t x,
-                                              int16_t y, boolean transact) {
-  uint16_t tftbuf[BUFPIXELS]; // Temp space for buffering TFT data
-  // Call core BMP-reading function, passing address to TFT object,
-  // TFT working buffer, and X & Y position of top-left corner (image
-  // will be cropped on load if necessary). Image pointer is NULL when
-  // reading to TFT, and transact argument is passed through.
-  return coreBMP(filename, &tft, tftbuf, x, y, NULL, transact);
+void Adafruit_ImageReader::setPipeline(int8_t core, uint8_t depth) {
+  pipeCore = core;
+  pipeDepth = (depth < 2) ? 2 : depth;
+}
+
+// Shared state between coreBMP() (consumer) and the scanline reader task
+// (producer). Buffer pointers circulate between the two queues: 'empty'
+// holds buffers available to be read into, 'full' holds buffers waiting
+// to be converted and drawn, in scanline order.
+struct BMPPipe {
+  Adafruit_ImageSource *in; // Data being read (only task touches it)
+  uint32_t offset;          // Start of image data in file
+  uint32_t rowSize;         // Bytes per BMP scanline, incl. padding
+  uint32_t rowBytes;        // Bytes read per scanline (clipped)
+  uint32_t first;           // Byte offset of first clipped pixel in row
+  int bmpHeight;            // Full image height
+  int loadY, loadHeight;    // Vertical region being loaded
+  boolean flip;             // BMP is stored bottom-to-top
+  QueueHandle_t empty;      // Buffers free to be filled
+  QueueHandle_t full;       // Buffers filled, awaiting conversion
+  SemaphoreHandle_t done;   // Given when task has read every row
+#if defined(IMAGEREADER_STATS)
+  Adafruit_ImageStats *stats; // Reads & seeks counted (not timed, they
+#endif                        // overlap the other core's work)
+};
+
+// Scanline reader task, seeks and reads each clipped row into the next
+// empty buffer and passes it (in order) to the consumer, then exits.
+static void bmpPipeTask(void *arg) {
+  BMPPipe *pipe = (BMPPipe *)arg;
+  uint8_t *buf;
+  for (int row = 0; row < pipe->loadHeight; row++) {
+    xQueueReceive(pipe->empty, &buf, portMAX_DELAY);
+    uint32_t pos = pipe->offset + pipe->first +
+                   (pipe->flip ? (pipe->bmpHeight - 1 - (row + pipe->loadY))
+                               : (row + pipe->loadY)) *
+                       pipe->rowSize;
+    if (pipe->in->position() != pos) {
+      pipe->in->seek(pos);
+      STAT_ADD(*pipe->stats, seeks, 1);
+    }
+    pipe->in->read(buf, pipe->rowBytes);
+    STAT_ADD(*pipe->stats, reads, 1);
+    STAT_ADD(*pipe->stats, bytesRead, pipe->rowBytes);
+    xQueueSend(pipe->full, &buf, portMAX_DELAY);
+  }
+  xSemaphoreGive(pipe->done);
+  vTaskDelete(NULL);
 }
 
 /*!
-    @brief   Loads BMP image file from SD card into RAM (as one of the GFX
+    @brief   Start loading a BMP image file into RAM on a background
+             FreeRTOS task, e.g. the next image of a slideshow while the
+             current one is shown, so that later drawing the image is only
+             a RAM-to-display blit. Any prefetch still in progress is
+             canceled first (one at a time per reader).
+    @param   filename
+             Name of BMP image file to load (copied, needn't be kept).
+    @param   img
+             Adafruit_Image object, loaded as by loadBMP(). Don't use (or
+             destroy) it until the prefetch is done.
+    @param   callback
+             Optional function called when the load ends (successfully or
+             not, including when canceled), on the prefetch task.
+    @param   arg
+             Pointer passed to callback, for application's use.
+    @param   core
+             Core (0 or 1) to run the task on, usually 0, the one NOT
+             running the Arduino loop, or -1 for either.
+    @return  IMAGE_SUCCESS if the prefetch was started (its own result
+             comes from prefetchWait() or the callback), IMAGE_ERR_MALLOC
+             if the task couldn't be created.
+    @note    Until prefetchDone() or prefetchWait() report the task has
+             finished, the reader itself is busy: don't call its other
+             draw or load functions (images loaded earlier can still be
+             drawn, or use a second Adafruit_ImageReader). Settings such
+             as setDownscale() apply as they were when the task reads
+             them, so change them before calling this.
+*/
+ImageReturnCode Adafruit_ImageReader::prefetchBMP(
+    const char *filename, Adafruit_Image &img,
+    Adafruit_PrefetchCallback callback, void *arg, int8_t core) {
+  cancelPrefetch();
+  if (!prefetchSem && !(prefetchSem = xSemaphoreCreateBinary()))
+    return IMAGE_ERR_MALLOC;
+  if (!(prefetchName = strdup(filename)))
+    return IMAGE_ERR_MALLOC;
+  prefetchImg = &img;
+  prefetchCallback = callback;
+  prefetchArg = arg;
+  if (xTaskCreatePinnedToCore(prefetchTask, "bmpPrefetch", 4096, this,
+                              uxTaskPriorityGet(NULL), NULL,
+                              (core < 0) ? tskNO_AFFINITY : core) != pdPASS) {
+    free(prefetchName);
+    prefetchName = NULL;
+    return IMAGE_ERR_MALLOC;
+  }
+  prefetching = true;
+  return IMAGE_SUCCESS;
+}
+
+// Prefetch task, loads the image, reports the result and exits. The
+// semaphore is given last; once it's taken the reader is idle again.
+void Adafruit_ImageReader::prefetchTask(void *arg) {
+  Adafruit_ImageReader *reader = (Adafruit_ImageReader *)arg;
+  ImageReturnCode status = reader->loadBMP(reader->prefetchName,
+                                           *reader->prefetchImg);
+  free(reader->prefetchName);
+  reader->prefetchName = NULL;
+  reader->prefetchStatus = status;
+  if (reader->prefetchCallback)
+    reader->prefetchCallback(status, *reader->prefetchImg,
+                             reader->prefetchArg);
+  xSemaphoreGive((SemaphoreHandle_t)reader->prefetchSem);
+  vTaskDelete(NULL);
+}
+
+/*!
+    @brief   Check (without waiting) whether prefetchBMP() has finished.
+    @return  true if finished or none was started (result is then
+             available from prefetchWait() without blocking), false if
+             still loading.
+*/
+boolean Adafruit_ImageReader::prefetchDone(void) {
+  if (prefetching &&
+      (xSemaphoreTake((SemaphoreHandle_t)prefetchSem, 0) == pdTRUE)) {
+    prefetching = false;
+    prefetchStop = false;
+  }
+  return !prefetching;
+}
+
+/*!
+    @brief   Wait for prefetchBMP() to finish.
+    @return  Result of the prefetch's load, one of the ImageReturnCode
+             values (IMAGE_ERR_CANCELED if stopped by cancelPrefetch()).
+             If none was started, the result of the last one.
+*/
+ImageReturnCode Adafruit_ImageReader::prefetchWait(void) {
+  if (prefetching) {
+    xSemaphoreTake((SemaphoreHandle_t)prefetchSem, portMAX_DELAY);
+    prefetching = false;
+    prefetchStop = false;
+  }
+  return prefetchStatus;
+}
+
+/*!
+    @brief   Stop prefetchBMP() if it's still in progress, e.g. when the
+             user skips past the image being prefetched. The load stops
+             at its next scanline and its image is freed; this returns
+             once the task has exited. An image that had already finished
+             loading is kept (see prefetchWait() for which).
+    @return  None (void).
+*/
+void Adafruit_ImageReader::cancelPrefetch(void) {
+  if (prefetching) {
+    prefetchStop = true;
+    prefetchWait();
+  }
+}
+#endif
+
+// Streaming decoder state for RLE-compressed BMPs. Compressed scanlines
+// vary in length and can't be seeked to, so data is read front to back
+// through the working buffer, one scanline (bottom-to-top) per rleRow().
+struct BMPRLE {
+  Adafruit_ImageSource *in; // Data being read, positioned at image data
+  Adafruit_SPITFT *tft; // If set (and transact), bus is handed off per read
+  boolean transact;     // SD & TFT sharing bus
+  uint8_t *buf;         // Read buffer (part of working buffer)
+  uint32_t bufSize;     // Size of buf in bytes
+  uint32_t len, idx;    // Bytes of data in buf, next byte to decode
+  uint8_t depth;        // 8 (BI_RLE8) or 4 (BI_RLE4)
+  int col;              // Column at which next scanline's data starts
+  int skip;             // Blank scanlines pending from a delta escape
+  boolean eof;          // End of bitmap (or file) reached
+#if defined(IMAGEREADER_STATS)
+  Adafruit_ImageStats *stats; // Refills are counted here
+#endif
+};
+
+// Next byte of compressed data, refilling buffer as needed, or -1 at end
+// of file.
+static int rleByte(BMPRLE &rle) {
+  if (rle.idx >= rle.len) {
+    if (rle.tft && rle.transact) {
+      rle.tft->dmaWait();  // Finish any DMA in progress and
+      rle.tft->endWrite(); // end TFT SPI transact
+    }
+    STAT_START(t);
+    int n = rle.in->read(rle.buf, rle.bufSize);
+    STAT_SINCE(*rle.stats, readMicros, t);
+    if (rle.tft && rle.transact) {
+      rle.tft->startWrite(); // Start TFT SPI transact
+      STAT_ADD(*rle.stats, transactions, 1);
+    }
+    rle.len = (n > 0) ? n : 0;
+    STAT_ADD(*rle.stats, reads, 1);
+    STAT_ADD(*rle.stats, bytesRead, rle.len);
+    rle.idx = 0;
+    if (!rle.len)
+      return -1;
+  }
+  return rle.buf[rle.idx++];
+}
+
+// Decode next scanline of RLE8/RLE4 data into 'line', one palette index
+// per byte, keeping only columns x0 to x0+w-1 (cropping). Encoded runs
+// outside that span are skipped over rather than expanded. Pixels not set
+// by the data (delta escapes, early end of line or bitmap) are index 0.
+static void rleRow(BMPRLE &rle, uint8_t *line, int x0, int w) {
+  int col = rle.col, x1 = x0 + w;
+  if (w > 0)
+    memset(line, 0, w);
+  if (rle.skip) { // Scanline was jumped over by a delta
+    rle.skip--;
+    return;
+  }
+  rle.col = 0; // Next scanline starts at left unless a delta says otherwise
+  while (!rle.eof) {
+    int n = rleByte(rle), v = rleByte(rle);
+    if ((n < 0) || (v < 0))
+      break;
+    if (n) { // Encoded run of n pixels, value v (4-bit: two alternating)
+      int a = (col > x0) ? col : x0, b = (col + n < x1) ? col + n : x1;
+      for (int i = a; i < b; i++)
+        line[i - x0] = (rle.depth == 8)
+                           ? v
+                           : (((i - col) & 1) ? (v & 0x0F) : (v >> 4));
+      col += n;
+    } else if (v == 0) { // End of scanline
+      return;
+    } else if (v == 1) { // End of bitmap
+      rle.eof = true;
+    } else if (v == 2) { // Delta, move right & up
+      int dx = rleByte(rle), dy = rleByte(rle);
+      if ((dx < 0) || (dy < 0))
+        break;
+      col += dx;
+      if (dy) { // Rest of this scanline and dy-1 more are blank
+        rle.col = col;
+        rle.skip = dy - 1;
+        return;
+      }
+    } else { // Absolute mode, v literal pixels padded to 16-bit boundary
+      int d = 0, bytes = (rle.depth == 8) ? v : (v + 1) / 2;
+      for (int i = 0; i < v; i++, col++) {
+        if ((rle.depth == 8) || !(i & 1)) {
+          if ((d = rleByte(rle)) < 0)
+            break;
+        }
+        if ((col >= x0) && (col < x1))
+          line[col - x0] =
+              (rle.depth == 8) ? d : ((i & 1) ? (d & 0x0F) : (d >> 4));
+      }
+      if (d < 0)
+        break;
+      if (bytes & 1)
+        (void)rleByte(rle);
+    }
+  }
+  rle.eof = true; // Out of data (or end of bitmap code)
+}
+
+// BMPInfo compression value for QOI images (not a BMP compression mode)
+#define COMPRESS_QOI 0xFF
+
+// Streaming decoder state for QOI images (qoiformat.org), decoded in one
+// pass front to back through the same read buffer as RLE (rleByte()).
+// Other than that, it keeps only the previous pixel, a run count and a
+// 64-entry table of recently seen colors, indexed by a hash of each.
+struct BMPQOI {
+  uint8_t index[64][4]; // Recently seen R,G,B,A colors
+  uint8_t px[4];        // Previous pixel, R,G,B,A
+  uint32_t run;         // Repeats of previous pixel still to be output
+  int width;            // Pixels per scanline
+  uint8_t bytes;        // Bytes per pixel out, 3 (B,G,R) or 4 (B,G,R,A)
+};
+
+// Decode next scanline of QOI data into 'line' as B,G,R(,A) bytes, the
+// same as 24- or 32-bit BMP pixels, keeping only columns x0 to x0+w-1
+// (cropping; every pixel must still be decoded). If the data ends early,
+// the rest of the image repeats the last pixel.
+static void qoiRow(BMPRLE &rle, BMPQOI &q, uint8_t *line, int x0, int w) {
+  uint8_t *px = q.px, *out = line;
+  for (int col = 0, x1 = x0 + w; col < q.width; col++) {
+    if (q.run) {
+      q.run--;
+    } else {
+      int op = rleByte(rle), d = 0;
+      if (op == 0xFE) { // QOI_OP_RGB, alpha unchanged
+        for (uint8_t i = 0; (i < 3) && (d >= 0); i++)
+          px[i] = d = rleByte(rle);
+      } else if (op == 0xFF) { // QOI_OP_RGBA
+        for (uint8_t i = 0; (i < 4) && (d >= 0); i++)
+          px[i] = d = rleByte(rle);
+      } else if (op >= 0xC0) { // QOI_OP_RUN, this pixel and up to 61 more
+        q.run = op & 0x3F;
+      } else if (op >= 0x80) { // QOI_OP_LUMA, green diff & red, blue vs it
+        int dg = (op & 0x3F) - 32;
+        if ((d = rleByte(rle)) >= 0) {
+          px[0] += dg - 8 + (d >> 4);
+          px[1] += dg;
+          px[2] += dg - 8 + (d & 0x0F);
+        }
+      } else if (op >= 0x40) { // QOI_OP_DIFF, small R,G,B diffs
+        px[0] += ((op >> 4) & 3) - 2;
+        px[1] += ((op >> 2) & 3) - 2;
+        px[2] += (op & 3) - 2;
+      } else if (op >= 0) { // QOI_OP_INDEX, previously seen color
+        memcpy(px, q.index[op], 4);
+      }
+      if ((op < 0) || (d < 0)) {
+        q.run = 0xFFFFFFFF; // Out of data, no more reads
+      } else {
+        memcpy(q.index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 63],
+               px, 4);
+      }
+    }
+    if (line && (col >= x0) && (col < x1)) {
+      out[0] = px[2];
+      out[1] = px[1];
+      out[2] = px[0];
+      if (q.bytes == 4)
+        out[3] = px[3];
+      out += q.bytes;
+    }
+  }
+}
+
+// Extract one color field (shift & bits, from mask) of a 16-bit pixel,
+// scaled to 8 bits by repeating its bits downward (e.g. 5-bit 31 = 255).
+static inline uint8_t maskTo8(uint16_t pixel, uint8_t shift, uint8_t bits) {
+  uint16_t v = ((pixel >> shift) & ((1 << bits) - 1)) << (8 - bits);
+  for (uint8_t b = bits; b < 8; b += bits)
+    v |= v >> b;
+  return v;
+}
+
+// Scanline decoders used by coreBMP(). Each converts n pixels of one
+// source format to one destination format, with no per-pixel tests of
+// depth or destination; coreBMP() picks one per call (bmpDecoder()).
+// New source formats get a decoder of their own here.
+struct BMPDecode {
+  const uint16_t *palette;  // 16-bit 5/6/5 palette, if indexed to TFT
+  const uint8_t *maskShift; // 16-bit R,G,B mask positions & sizes
+  const uint8_t *maskBits;
+  uint8_t bitFirst; // Bit offset of first pixel in src[0], if <8-bit
+};
+typedef void (*BMPDecoder)(const uint8_t *src, void *dest, uint32_t n,
+                           const BMPDecode &d);
+
+// 24-bit BMP pixels (B,G,R byte order) to 16-bit 565 color, optionally
+// byte-swapped (big-endian, as SPI displays take it, so SPITFT needn't
+// swap them on the way out). On little-endian devices, each 4 pixels
+// (12 bytes) are fetched as three 32-bit words rather than 12 byte
+// loads; memcpy() compiles to plain word loads where the CPU handles
+// unaligned access (src may be on any byte boundary).
+template <boolean SWAP>
+static void decode24(const uint8_t *src, void *dest, uint32_t n,
+                     const BMPDecode &d) {
+  uint16_t *out = (uint16_t *)dest, p;
+  (void)d; // No parameters needed
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  for (; n >= 4; n -= 4) {
+    uint32_t w0, w1, w2; // B0 G0 R0 B1, G1 R1 B2 G2, R2 B3 G3 R3 (LSB 1st)
+    memcpy(&w0, src, 4);
+    memcpy(&w1, src + 4, 4);
+    memcpy(&w2, src + 8, 4);
+    src += 12;
+    uint16_t p0 = ((w0 >> 8) & 0xF800) | ((w0 >> 5) & 0x07E0) |
+                  ((w0 >> 3) & 0x001F),
+             p1 = (w1 & 0xF800) | ((w1 << 3) & 0x07E0) | (w0 >> 27),
+             p2 = ((w2 << 8) & 0xF800) | ((w1 >> 21) & 0x07E0) |
+                  ((w1 >> 19) & 0x001F),
+             p3 = ((w2 >> 16) & 0xF800) | ((w2 >> 13) & 0x07E0) |
+                  ((w2 >> 11) & 0x001F);
+    if (SWAP) {
+      p0 = (p0 >> 8) | (p0 << 8);
+      p1 = (p1 >> 8) | (p1 << 8);
+      p2 = (p2 >> 8) | (p2 << 8);
+      p3 = (p3 >> 8) | (p3 << 8);
+    }
+    out[0] = p0;
+    out[1] = p1;
+    out[2] = p2;
+    out[3] = p3;
+    out += 4;
+  }
+#endif
+  while (n--) { // Remaining pixels (or all, if big-endian)
+    p = ((src[2] & 0xF8) << 8) | ((src[1] & 0xFC) << 3) | (src[0] >> 3);
+    src += 3;
+    *out++ = SWAP ? (uint16_t)((p >> 8) | (p << 8)) : p;
+  }
+}
+
+// 32-bit BMP pixels (B,G,R,A byte order) to 16-bit 565 color, optionally
+// byte-swapped as for 24-bit. Alpha is ignored here (see alphaBits()).
+// On little-endian devices each pixel is fetched as one 32-bit word.
+template <boolean SWAP>
+static void decode32(const uint8_t *src, void *dest, uint32_t n,
+                     const BMPDecode &d) {
+  uint16_t *out = (uint16_t *)dest, p;
+  (void)d; // No parameters needed
+  while (n--) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    uint32_t w; // B G R A (LSB 1st)
+    memcpy(&w, src, 4);
+    p = ((w >> 8) & 0xF800) | ((w >> 5) & 0x07E0) | ((w >> 3) & 0x001F);
+#else
+    p = ((src[2] & 0xF8) << 8) | ((src[1] & 0xFC) << 3) | (src[0] >> 3);
+#endif
+    src += 4;
+    *out++ = SWAP ? (uint16_t)((p >> 8) | (p << 8)) : p;
+  }
+}
+
+// Alpha bytes of 32-bit BMP pixels to canvas1 mask bits, MSB first, set
+// if at least half opaque. 'step' is bytes from one pixel to the next
+// (4, or more if downscaling). Whole bytes are written, the mask's
+// padding bits past the last pixel are clear.
+static void alphaBits(const uint8_t *src, uint8_t *out, uint32_t n,
+                      uint32_t step) {
+  uint8_t bits = 0, bit = 0x80;
+  for (src += 3; n--; src += step) {
+    if (*src >= 0x80)
+      bits |= bit;
+    if (!(bit >>= 1)) {
+      *out++ = bits;
+      bits = 0;
+      bit = 0x80;
+    }
+  }
+  if (bit != 0x80)
+    *out = bits;
+}
+
+// 16-bit BMP pixels with other color masks (e.g. 555) to 565: scale
+// each field to 8 bits, then to 565 as for 24-bit.
+static void decode16(const uint8_t *src, void *dest, uint32_t n,
+                     const BMPDecode &d) {
+  uint16_t *out = (uint16_t *)dest;
+  while (n--) {
+    uint16_t p = src[0] | (src[1] << 8);
+    src += 2;
+    uint8_t r = maskTo8(p, d.maskShift[0], d.maskBits[0]),
+            g = maskTo8(p, d.maskShift[1], d.maskBits[1]),
+            b = maskTo8(p, d.maskShift[2], d.maskBits[2]);
+    *out++ = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+  }
+}
+
+// 8-, 4- or 1-bit palette indices to 565 color (T = uint16_t, looked up
+// in palette, for TFT) or to one index per byte (T = uint8_t, canvas8).
+template <uint8_t DEPTH, typename T>
+static void decodeIndexed(const uint8_t *src, void *dest, uint32_t n,
+                          const BMPDecode &d) {
+  T *out = (T *)dest;
+  uint8_t bit = 8 - DEPTH - d.bitFirst; // Shift down to first pixel's index
+  while (n--) {
+    uint8_t i;
+    if (DEPTH == 8) {
+      i = *src++;
+    } else {
+      i = (*src >> bit) & ((1 << DEPTH) - 1);
+      if (!bit) {
+        src++;
+        bit = 8 - DEPTH;
+      } else {
+        bit -= DEPTH;
+      }
+    }
+    *out++ = (sizeof(T) > 1) ? d.palette[i] : i;
+  }
+}
+
+// 1-bit palette indices to 565 color for TFT, a source byte at a time:
+// each byte's 8 pixels are looked up in a 2-color table. Only a partial
+// first byte (clipped on the left) and last byte go a bit at a time.
+static void decodeMono(const uint8_t *src, void *dest, uint32_t n,
+                       const BMPDecode &d) {
+  uint16_t *out = (uint16_t *)dest;
+  const uint16_t lut[2] = {d.palette[0], d.palette[1]};
+  if (d.bitFirst) { // Rest of first byte
+    for (int8_t bit = 7 - d.bitFirst; (bit >= 0) && n; bit--, n--)
+      *out++ = lut[(*src >> bit) & 1];
+    src++;
+  }
+  for (; n >= 8; n -= 8) {
+    uint8_t b = *src++;
+    out[0] = lut[b >> 7];
+    out[1] = lut[(b >> 6) & 1];
+    out[2] = lut[(b >> 5) & 1];
+    out[3] = lut[(b >> 4) & 1];
+    out[4] = lut[(b >> 3) & 1];
+    out[5] = lut[(b >> 2) & 1];
+    out[6] = lut[(b >> 1) & 1];
+    out[7] = lut[b & 1];
+    out += 8;
+  }
+  for (int8_t bit = 7; n; bit--, n--) // Start of last byte
+    *out++ = lut[(*src >> bit) & 1];
+}
+
+// 1-bit pixels to canvas1 buffer, MSB first. Bits are palette indices,
+// same as the canvas (image keeps the palette), so they're copied as-is:
+// whole bytes if the first pixel is byte-aligned in the source, else
+// each output byte is merged from two source bytes. Canvas bits past
+// the last pixel are left alone.
+static void decodeBits(const uint8_t *src, void *dest, uint32_t n,
+                       const BMPDecode &d) {
+  uint8_t *out = (uint8_t *)dest, shift = d.bitFirst;
+  uint32_t bytes = n / 8;
+  if (!shift) {
+    memcpy(out, src, bytes);
+  } else {
+    // Source has (shift + n + 7) / 8 bytes, so src[i + 1] exists for
+    // every whole output byte.
+    for (uint32_t i = 0; i < bytes; i++)
+      out[i] = (src[i] << shift) | (src[i + 1] >> (8 - shift));
+  }
+  if (n & 7) { // Partial last byte
+    uint8_t mask = 0xFF << (8 - (n & 7)),
+            b = src[bytes] << shift; // Next pixels, first at MSB
+    if (shift + (n & 7) > 8)         // Continued in another source byte
+      b |= src[bytes + 1] >> (8 - shift);
+    out[bytes] = (out[bytes] & ~mask) | (b & mask);
+  }
+}
+
+// Pick scanline decoder for source bits per pixel and destination:
+// 565 (TFT or sink, byte-swapped for TFT if 24- or 32-bit) or canvas.
+static BMPDecoder bmpDecoder(uint8_t depth, boolean to565, boolean swap) {
+  switch (depth) {
+  case 32:
+    return swap ? decode32<true> : decode32<false>;
+  case 24:
+    return swap ? decode24<true> : decode24<false>;
+  case 16:
+    return decode16;
+  case 8:
+    return to565 ? decodeIndexed<8, uint16_t> : decodeIndexed<8, uint8_t>;
+  case 4:
+    return to565 ? decodeIndexed<4, uint16_t> : decodeIndexed<4, uint8_t>;
+  default:
+    return to565 ? decodeMono : decodeBits;
+  }
+}
+
+/*!
+    @brief   Set the number of BMP scanlines read from the file at a time
+             by drawBMP() and loadBMP(). When the image is not cropped
+             horizontally, this many whole scanlines (padding included)
+             are fetched with a single read, cutting down on small
+             filesystem reads and, if drawing with 'transact', on SPI
+             transaction handoffs between the file and the display.
+             Cropped images are read one clipped scanline at a time.
+    @param   rows
+             Scanlines per read, 1 (default) or more. The working buffer
+             (if not supplied with setBuffer()) is allocated on the heap
+             for the duration of each call, sized to this many image rows
+             plus, if drawing to a screen, two scanlines of 16-bit pixels.
+    @return  None (void).
+*/
+void Adafruit_ImageReader::setBufferRows(uint8_t rows) {
+  bufRows = rows ? rows : 1;
+}
+
+/*!
+    @brief   Supply a working buffer for drawBMP() and loadBMP(), instead
+             of one being allocated on the heap for each call. Useful for
+             avoiding heap churn, or to place the buffer in a particular
+             type of memory.
+    @param   buf
+             Pointer to buffer, must be at least 16-bit aligned, or NULL to
+             resume heap allocation. Must remain valid while any image functions
+             are called. Not used by incremental draws (beginDraw()), which
+             allocate their own buffer as other calls may use this one
+             between steps.
+    @param   len
+             Size of buffer in bytes. If drawing to a screen, this must fit
+             four bytes per pixel (two 16-bit scanlines, alternated for
+             DMA) of the visible image width; the remainder is used to read
+             BMP data, as many whole scanlines as will fit (if uncropped)
+             or at least one clipped scanline. If too small for a given
+             image, a heap buffer is used for that call instead.
+    @return  None (void).
+*/
+void Adafruit_ImageReader::setBuffer(void *buf, uint32_t len) {
+  userBuf = (uint8_t *)buf;
+  userBufLen = buf ? len : 0;
+}
+
+/*!
+    @brief   Set memory allocation policy for loadBMP() canvases and
+             palettes, and for working buffers (those not supplied with
+             setBuffer()) of all draw and load functions. Each image keeps
+             a pointer to the allocator it was loaded with, and frees its
+             memory the same way.
+    @param   a
+             Pointer to an Adafruit_ImageAllocator (or subclass) object,
+             e.g. Adafruit_ImageAllocatorPSRAM on ESP32 to keep large
+             canvases out of internal RAM, or NULL to use the heap
+             (default). Must remain valid as long as any image loaded with
+             it, and must not change while a call is in progress.
+    @return  None (void).
+*/
+void Adafruit_ImageReader::setAllocator(Adafruit_ImageAllocator *a) {
+  allocator = a ? a : &heapAllocator;
+}
+
+/*!
+    @brief   Enable or disable canvas reuse by loadBMP(). When enabled, an
+             Adafruit_Image that already holds a canvas of the same type
+             and size (e.g. the previous frame of an animation or
+             slideshow) keeps it, and it's overwritten with the new image,
+             rather than being freed and allocated again each time. It's
+             only reallocated if the new image doesn't match. Either way,
+             the image is cleared if loading fails.
+    @param   reuse
+             true to reuse matching canvases, false (default) to always
+             allocate new.
+    @return  None (void).
+*/
+void Adafruit_ImageReader::setReuseCanvas(boolean reuse) {
+  reuseCanvas = reuse;
+}
+
+/*!
+    @brief   Set integer downscaling for subsequent drawBMP() and loadBMP()
+             calls, for thumbnails. Each output pixel comes from a square of
+             2^shift x 2^shift source pixels, and only the scanlines that
+             are needed are read: point sampling reads one of every 2^shift,
+             so a 1/4 scale image costs about 1/16 the conversion work of
+             the full image (RLE and QOI data must still be decoded
+             throughout).
+             Position and source rectangle arguments stay in display and
+             source pixels respectively; any partial square at the right or
+             bottom edge is dropped. Does not apply to drawRAW().
+    @param   shift
+             Scale is 1 / 2^shift: 0 = full size (default), 1 = 1/2,
+             2 = 1/4, 3 = 1/8.
+    @param   average
+             If true, box-average each square of source pixels (smoother,
+             but every scanline is read). Applies to 24- and 16-bit images;
+             palette and 1-bit images are always point sampled, keeping
+             their loadBMP() canvas formats. If false (default), use the
+             top-left pixel of each square.
+    @return  None (void).
+*/
+void Adafruit_ImageReader::setDownscale(uint8_t shift, boolean average) {
+  scaleShift = (shift > 3) ? 3 : shift;
+  scaleAvg = average;
+}
+
+/*!
+    @brief   Opens a BMP image file and parses its header (and color
+             palette, if any) into an Adafruit_BMPInfo handle, which can
+             then be drawn or loaded any number of times (see the drawBMP()
+             and loadBMP() variants accepting an Adafruit_BMPInfo) without
+             re-opening the file and re-parsing the header for each.
+    @param   filename
+             Name of BMP image file to open.
+    @param   bmp
+             Adafruit_BMPInfo object. Any file previously associated with
+             it is closed first.
+    @param   keepOpen
+             If true (default), the file is kept open until the handle is
+             closed, avoiding another filesystem open() per draw. If false,
+             the file is closed once parsed and re-opened (by name, from
+             this reader's filesystem) for each draw, which uses fewer
+             file descriptors when many handles are kept around.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure). IMAGE_ERR_FORMAT is
+             returned for BMP variants drawBMP() and loadBMP() can't handle.
+*/
+ImageReturnCode Adafruit_ImageReader::openBMP(const char *filename,
+                                              Adafruit_BMPInfo &bmp,
+                                              boolean keepOpen) {
+  STAT_RESET(stats);
+  bmp.close();
+
+  // Open requested file on SD card
+  STAT_TIME(stats, openMicros, bmp.file = filesys->open(filename, FILE_READ));
+  if (!bmp.file) {
+    return IMAGE_ERR_FILE_NOT_FOUND;
+  }
+
+  ImageReturnCode status;
+  STAT_TIME(stats, parseMicros, status = parseBMP(bmp));
+  if (status != IMAGE_SUCCESS) {
+    bmp.close();
+  } else if (!keepOpen) {
+    // Keep name for re-opening later. If even that small allocation
+    // fails, the file is simply left open.
+    if ((bmp.filename = (char *)malloc(strlen(filename) + 1))) {
+      strcpy(bmp.filename, filename);
+      bmp.file.close();
+    }
+  }
+  return status;
+}
+
+/*!
+    @brief   Parses header of a BMP image from an Adafruit_ImageSource
+             (e.g. Adafruit_ImageMemory for an image compiled into
+             firmware, or Adafruit_ImageStream for one arriving over the
+             network), which is then read by drawBMP() and loadBMP() calls
+             accepting the returned handle.
+    @param   source
+             Adafruit_ImageSource holding the BMP image (seekable sources
+             are rewound to its start, forward-only ones must be there
+             already). Must stay valid while the handle is used. A
+             seekable source can be drawn or loaded any number of times,
+             a forward-only one only once.
+    @param   bmp
+             Adafruit_BMPInfo object. Any file previously associated with
+             it is closed first. On success, the header has been read and
+             checked and the image can be drawn or loaded.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure). IMAGE_ERR_FORMAT is
+             returned for BMP variants drawBMP() and loadBMP() can't handle.
+*/
+ImageReturnCode Adafruit_ImageReader::openBMP(Adafruit_ImageSource &source,
+                                              Adafruit_BMPInfo &bmp) {
+  STAT_RESET(stats);
+  bmp.close();
+  bmp.source = &source;
+  if (source.seekable()) // Start from the top, even if used before
+    source.seek(0);
+  ImageReturnCode status;
+  STAT_TIME(stats, parseMicros, status = parseBMP(bmp));
+  if (status != IMAGE_SUCCESS)
+    bmp.close();
+  return status;
+}
+
+/*!
+    @brief   Draws BMP image from an Adafruit_ImageSource directly to
+             SPITFT screen. Forward-only sources (e.g. a network Stream)
+             are read front to back; bottom-to-top images are then drawn
+             that way, one scanline at a time.
+    @param   source
+             Adafruit_ImageSource positioned at the start of the BMP image.
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @param   transact
+             Pass 'true' if TFT and the source (e.g. SD card, or WiFi
+             co-processor) are on the same SPI bus, in which case SPI
+             transactions are necessary. If separate peripherals, can
+             pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(Adafruit_ImageSource &source,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y, boolean transact) {
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(source, bmp);
+  if (status == IMAGE_SUCCESS)
+    status = coreBMP(bmp, &tft, x, y, 0, 0, bmp.bmpWidth, bmp.bmpHeight, NULL,
+                     transact);
+  return status;
+}
+
+/*!
+    @brief   Loads BMP image from an Adafruit_ImageSource into RAM (as one
+             of the GFX canvas object types).
+    @param   source
+             Adafruit_ImageSource positioned at the start of the BMP image.
+    @param   img
+             Adafruit_Image object, contents will be initialized, allocated
+             and loaded on success (else cleared).
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::loadBMP(Adafruit_ImageSource &source,
+                                              Adafruit_Image &img) {
+  if (!reuseCanvas)
+    img.dealloc();
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(source, bmp);
+  if (status == IMAGE_SUCCESS)
+    status = coreBMP(bmp, NULL, 0, 0, 0, 0, bmp.bmpWidth, bmp.bmpHeight, &img,
+                     false);
+  else
+    img.dealloc();
+  return status;
+}
+
+/*!
+    @brief   Opens an image pack file (made with the imagepack.py script in
+             the 'extras' folder) and reads its index into RAM. The file is
+             kept open until the pack is closed, and images in it are found
+             by name with pack.select() and drawn or loaded by passing the
+             pack as the source to drawBMP(), loadBMP() or drawRAW(). File
+             layout (multi-byte values little-endian):
+               - 4 bytes: signature, ASCII 'IPAK'
+               - 2 bytes: version, 1
+               - 2 bytes: number of images
+               - 4 bytes: size of name table in bytes
+               - 4 bytes: reserved, 0
+               - 12 bytes per image, sorted by name (byte order):
+                 - 4 bytes: position of image in pack file
+                 - 4 bytes: size of image in bytes
+                 - 2 bytes: position of name in name table
+                 - 1 byte: type, an ImagePackFormat value
+                 - 1 byte: reserved, 0
+               - name table, NUL-terminated names
+               - images, each a complete BMP or raw file
+    @param   filename
+             Name of pack file to open.
+    @param   pack
+             Adafruit_ImagePack object. Any pack previously opened with it
+             is closed first.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure). IMAGE_ERR_FORMAT is
+             returned if the file isn't a valid pack, IMAGE_ERR_MALLOC if
+             there's no RAM for its index.
+*/
+ImageReturnCode Adafruit_ImageReader::openPack(const char *filename,
+                                               Adafruit_ImagePack &pack) {
+  ImageReturnCode status = IMAGE_ERR_FORMAT; // Guilty until innocent
+  uint8_t hdr[PACK_HEADER];
+
+  pack.close();
+  if (!(pack.file = filesys->open(filename, FILE_READ)))
+    return IMAGE_ERR_FILE_NOT_FOUND;
+
+  if ((bmpRead(pack.file, hdr, sizeof hdr) == sizeof hdr) &&
+      !memcmp(hdr, "IPAK", 4) && (hdr[4] == 1) && !hdr[5]) {
+    uint16_t count = hdr[6] | (hdr[7] << 8);
+    uint32_t namesSize = le32(&hdr[8]),
+             indexSize = count * PACK_ENTRY + namesSize;
+    if (!(pack.index = (uint8_t *)malloc(indexSize ? indexSize : 1))) {
+      status = IMAGE_ERR_MALLOC;
+    } else if (bmpRead(pack.file, pack.index, indexSize) ==
+               (int)indexSize) {
+      // Every name must be in the table and terminated, so lookups
+      // can't run off the end of it.
+      const uint8_t *names = &pack.index[count * PACK_ENTRY];
+      status = (!namesSize || !names[namesSize - 1]) ? IMAGE_SUCCESS
+                                                     : IMAGE_ERR_FORMAT;
+      for (uint16_t i = 0; (i < count) && (status == IMAGE_SUCCESS); i++) {
+        const uint8_t *e = &pack.index[i * PACK_ENTRY];
+        if ((uint16_t)(e[8] | (e[9] << 8)) >= namesSize)
+          status = IMAGE_ERR_FORMAT;
+      }
+      pack.entries = count;
+    }
+  }
+  if (status != IMAGE_SUCCESS)
+    pack.close();
+  return status;
+}
+
+/*!
+    @brief   Loads BMP image file from SD card directly to SPITFT screen.
+    @param   filename
+             Name of BMP image file to load.
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @param   transact
+             Pass 'true' if TFT and SD are on the same SPI bus, in which
+             case SPI transactions are necessary. If separate peripherals,
+             can pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(char *filename,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y, boolean transact) {
+  // If BMP is being drawn off the right or bottom edge of the screen,
+  // nothing to do here. NOT an error, just a trivial clip operation.
+  if ((x >= tft.width()) || (y >= tft.height())) {
+    STAT_RESET(stats);
+    return IMAGE_SUCCESS;
+  }
+
+  // Open and parse file, then call core BMP-reading function, passing
+  // address to TFT object and X & Y position of top-left corner (image
+  // will be cropped on load if necessary). Image pointer is NULL when
+  // reading to TFT, and transact argument is passed through. File is
+  // closed when 'bmp' goes out of scope.
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(filename, bmp);
+  if (status == IMAGE_SUCCESS)
+    status = coreBMP(bmp, &tft, x, y, 0, 0, bmp.bmpWidth, bmp.bmpHeight, NULL,
+                     transact);
+  return status;
+}
+
+/*!
+    @brief   Draws previously-opened BMP image directly to SPITFT screen.
+    @param   bmp
+             Adafruit_BMPInfo handle from openBMP().
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @param   transact
+             Pass 'true' if TFT and SD are on the same SPI bus, in which
+             case SPI transactions are necessary. If separate peripherals,
+             can pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(Adafruit_BMPInfo &bmp,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y, boolean transact) {
+  STAT_RESET(stats);
+  return coreBMP(bmp, &tft, x, y, 0, 0, bmp.bmpWidth, bmp.bmpHeight, NULL,
+                 transact);
+}
+
+/*!
+    @brief   Draws BMP image file to an Adafruit_ImageSink, which is given
+             the image a scanline of 565 pixels at a time (e.g. for a
+             display not using Adafruit_SPITFT, or to composite, encode or
+             otherwise process the image without holding all of it).
+    @param   filename
+             Name of BMP image file to draw.
+    @param   sink
+             Adafruit_ImageSink object (subclass) to receive scanlines.
+    @param   x
+             Horizontal offset in pixels, as for drawing to a TFT. The
+             image is clipped to the sink's width() and height().
+    @param   y
+             Vertical offset in pixels.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(char *filename,
+                                              Adafruit_ImageSink &sink,
+                                              int16_t x, int16_t y) {
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(filename, bmp);
+  if (status == IMAGE_SUCCESS)
+    status = coreBMP(bmp, NULL, x, y, 0, 0, bmp.bmpWidth, bmp.bmpHeight, NULL,
+                     false, &sink);
+  return status;
+}
+
+/*!
+    @brief   Draws previously-opened BMP image to an Adafruit_ImageSink.
+    @param   bmp
+             Adafruit_BMPInfo handle from openBMP().
+    @param   sink
+             Adafruit_ImageSink object (subclass) to receive scanlines.
+    @param   x
+             Horizontal offset in pixels, as for drawing to a TFT. The
+             image is clipped to the sink's width() and height().
+    @param   y
+             Vertical offset in pixels.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(Adafruit_BMPInfo &bmp,
+                                              Adafruit_ImageSink &sink,
+                                              int16_t x, int16_t y) {
+  STAT_RESET(stats);
+  return coreBMP(bmp, NULL, x, y, 0, 0, bmp.bmpWidth, bmp.bmpHeight, NULL,
+                 false, &sink);
+}
+
+/*!
+    @brief   Loads BMP image file from SD card into RAM (as one of the GFX
              canvas object types) for use with the bitmap-drawing functions.
              Not practical for most AVR microcontrollers, but some of the
              more capable 32-bit micros can afford some RAM for this.
@@ -272,31 +2086,841 @@ ImageReturnCode Adafruit_ImageReader::drawBMP(char *filename,
 */
 ImageReturnCode Adafruit_ImageReader::loadBMP(char *filename,
                                               Adafruit_Image &img) {
-  // Call core BMP-reading function. TFT and working buffer are NULL
-  // (unused and allocated in function, respectively), X & Y position are
-  // always 0 because full image is loaded (RAM permitting). Adafruit_Image
-  // argument is passed through, and SPI transactions are not needed when
-  // loading to RAM (bus is not shared during load).
-  return coreBMP(filename, NULL, NULL, 0, 0, &img, false);
+  // If an Adafruit_Image object is passed and currently contains anything,
+  // free its contents as it's about to be overwritten with new stuff
+  // (unless its canvas may be reused, see setReuseCanvas()).
+  if (!reuseCanvas)
+    img.dealloc();
+
+  // Open and parse file, then call core BMP-reading function. TFT is NULL
+  // (unused), X & Y position are always 0 because full image is loaded
+  // (RAM permitting). Adafruit_Image argument is passed through, and SPI
+  // transactions are not needed when loading to RAM (bus is not shared
+  // during load).
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(filename, bmp);
+  if (status == IMAGE_SUCCESS)
+    status = coreBMP(bmp, NULL, 0, 0, 0, 0, bmp.bmpWidth, bmp.bmpHeight, &img,
+                     false);
+  else
+    img.dealloc();
+  return status;
+}
+
+/*!
+    @brief   Loads previously-opened BMP image into RAM (as one of the GFX
+             canvas object types) for use with the bitmap-drawing functions.
+    @param   bmp
+             Adafruit_BMPInfo handle from openBMP().
+    @param   img
+             Adafruit_Image object, contents will be initialized, allocated
+             and loaded on success (else cleared).
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::loadBMP(Adafruit_BMPInfo &bmp,
+                                              Adafruit_Image &img) {
+  STAT_RESET(stats);
+  return coreBMP(bmp, NULL, 0, 0, 0, 0, bmp.bmpWidth, bmp.bmpHeight, &img,
+                 false);
+}
+
+/*!
+    @brief   Draws a rectangular section of a BMP image file (e.g. one
+             sprite from a sprite sheet) directly to SPITFT screen. Only
+             the needed span of each needed scanline is read from the file.
+    @param   filename
+             Name of BMP image file to load.
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal screen position of section's left edge. Value is
+             signed, section will be clipped if all or part is off the
+             screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical screen position of section's top edge.
+    @param   srcX
+             Left edge of section within BMP image, in pixels.
+    @param   srcY
+             Top edge of section within BMP image, in pixels.
+    @param   srcW
+             Width of section in pixels.
+    @param   srcH
+             Height of section in pixels. Section is clipped to the image
+             bounds.
+    @param   transact
+             Pass 'true' if TFT and SD are on the same SPI bus, in which
+             case SPI transactions are necessary. If separate peripherals,
+             can pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(char *filename,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y, int16_t srcX,
+                                              int16_t srcY, int16_t srcW,
+                                              int16_t srcH, boolean transact) {
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(filename, bmp);
+  if (status == IMAGE_SUCCESS)
+    status = coreBMP(bmp, &tft, x, y, srcX, srcY, srcW, srcH, NULL, transact);
+  return status;
+}
+
+/*!
+    @brief   Draws a rectangular section of a previously-opened BMP image
+             (e.g. one sprite from a sprite sheet kept open with openBMP())
+             directly to SPITFT screen. Only the needed span of each needed
+             scanline is read from the file.
+    @param   bmp
+             Adafruit_BMPInfo handle from openBMP().
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal screen position of section's left edge. Value is
+             signed, section will be clipped if all or part is off the
+             screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical screen position of section's top edge.
+    @param   srcX
+             Left edge of section within BMP image, in pixels.
+    @param   srcY
+             Top edge of section within BMP image, in pixels.
+    @param   srcW
+             Width of section in pixels.
+    @param   srcH
+             Height of section in pixels. Section is clipped to the image
+             bounds.
+    @param   transact
+             Pass 'true' if TFT and SD are on the same SPI bus, in which
+             case SPI transactions are necessary. If separate peripherals,
+             can pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(Adafruit_BMPInfo &bmp,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y, int16_t srcX,
+                                              int16_t srcY, int16_t srcW,
+                                              int16_t srcH, boolean transact) {
+  STAT_RESET(stats);
+  return coreBMP(bmp, &tft, x, y, srcX, srcY, srcW, srcH, NULL, transact);
+}
+
+/*!
+    @brief   Loads a rectangular section of a BMP image file (e.g. one
+             sprite from a sprite sheet) into RAM (as one of the GFX canvas
+             object types). Only the needed span of each needed scanline
+             is read from the file.
+    @param   filename
+             Name of BMP image file to load.
+    @param   img
+             Adafruit_Image object, contents will be initialized, allocated
+             and loaded on success (else cleared). Canvas is the size of
+             the section.
+    @param   srcX
+             Left edge of section within BMP image, in pixels.
+    @param   srcY
+             Top edge of section within BMP image, in pixels.
+    @param   srcW
+             Width of section in pixels.
+    @param   srcH
+             Height of section in pixels. Section is clipped to the image
+             bounds.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure). IMAGE_ERR_FORMAT is
+             returned if the section is entirely outside the image.
+*/
+ImageReturnCode Adafruit_ImageReader::loadBMP(char *filename,
+                                              Adafruit_Image &img,
+                                              int16_t srcX, int16_t srcY,
+                                              int16_t srcW, int16_t srcH) {
+  if (!reuseCanvas)
+    img.dealloc();
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(filename, bmp);
+  if (status == IMAGE_SUCCESS)
+    status = coreBMP(bmp, NULL, 0, 0, srcX, srcY, srcW, srcH, &img, false);
+  else
+    img.dealloc();
+  return status;
+}
+
+/*!
+    @brief   Loads a rectangular section of a previously-opened BMP image
+             (e.g. one sprite from a sprite sheet kept open with openBMP())
+             into RAM (as one of the GFX canvas object types). Only the
+             needed span of each needed scanline is read from the file.
+    @param   bmp
+             Adafruit_BMPInfo handle from openBMP().
+    @param   img
+             Adafruit_Image object, contents will be initialized, allocated
+             and loaded on success (else cleared). Canvas is the size of
+             the section.
+    @param   srcX
+             Left edge of section within BMP image, in pixels.
+    @param   srcY
+             Top edge of section within BMP image, in pixels.
+    @param   srcW
+             Width of section in pixels.
+    @param   srcH
+             Height of section in pixels. Section is clipped to the image
+             bounds.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure). IMAGE_ERR_FORMAT is
+             returned if the section is entirely outside the image.
+*/
+ImageReturnCode Adafruit_ImageReader::loadBMP(Adafruit_BMPInfo &bmp,
+                                              Adafruit_Image &img,
+                                              int16_t srcX, int16_t srcY,
+                                              int16_t srcW, int16_t srcH) {
+  STAT_RESET(stats);
+  return coreBMP(bmp, NULL, 0, 0, srcX, srcY, srcW, srcH, &img, false);
+}
+
+/*!
+    @brief   Begins an incremental draw of a BMP image to SPITFT screen:
+             opens and parses the image, then the image is drawn a slice
+             of rows at a time with draw.step() or draw.stepMicros(),
+             called repeatedly (e.g. once per main loop) until draw.done()
+             returns true. Other work (touch, networking, etc.) can be
+             serviced in between, rather than waiting on an entire
+             drawBMP(). The draw is set up here once (working buffers,
+             decoder, TFT address window), so reader settings (buffer,
+             downscale, etc.) can't be changed until the draw is done.
+             Other reader calls (drawBMP(), loadBMP(), etc.) can be made
+             between steps: the draw's working buffer is always allocated
+             with the reader's allocator, never the setBuffer() one. Other
+             devices on the same SPI bus (e.g. the SD card) can also be
+             used between steps, and other things (progress bar, touch
+             feedback, etc.) drawn to this screen, as each step sets the
+             TFT's address window again.
+    @param   filename
+             Name of BMP image file to draw.
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @param   draw
+             Adafruit_BMPDraw object, holds open file and decoder state
+             between steps. Any draw already in progress with it is
+             cancelled.
+    @param   transact
+             Pass 'true' if TFT and SD are on the same SPI bus, in which
+             case SPI transactions are necessary. If separate peripherals,
+             can pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS if draw can
+             proceed, or if there's nothing to draw, with draw.done()
+             already true; other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::beginDraw(const char *filename,
+                                                Adafruit_SPITFT &tft,
+                                                int16_t x, int16_t y,
+                                                Adafruit_BMPDraw &draw,
+                                                boolean transact) {
+  STAT_RESET(stats);
+  draw.cancel();
+  draw.reader = this;
+  draw.row = draw.rows = 0;
+  if ((x >= tft.width()) || (y >= tft.height())) // Trivial clip
+    return draw.status = IMAGE_SUCCESS;
+  if ((draw.status = openBMP(filename, draw.bmp)) == IMAGE_SUCCESS) {
+    // Rows are counted in output (downscaled) pixels, as clipped to
+    // the screen
+    draw.status = beginBMP(draw.core, draw.bmp, &tft, x, y, 0, 0,
+                           draw.bmp.bmpWidth, draw.bmp.bmpHeight, NULL, 0,
+                           transact, &draw.rows);
+    if (draw.done())
+      draw.cancel();
+  }
+  return draw.status;
+}
+
+// Parse 8-byte header of raw image (see drawRAW()), returns true if valid.
+static boolean rawHeader(const uint8_t *hdr, int *width, int *height,
+                         boolean *bigEndian) {
+  if ((hdr[0] != 'R') || (hdr[1] != 'W') || (hdr[6] != 1) || (hdr[7] > 1))
+    return false; // Not raw image, or not 565 color & known byte order
+  *width = hdr[2] | (hdr[3] << 8);
+  *height = hdr[4] | (hdr[5] << 8);
+  *bigEndian = hdr[7];
+  return true;
+}
+
+/*!
+    @brief   Loads "panel-native" raw image file from SD card directly to
+             SPITFT screen. Pixels in this format are already 16-bit 565
+             color, usually in the display's own (big-endian) byte order,
+             so they're read straight into a buffer and issued to the
+             screen with no conversion by the CPU. Such files are made
+             from BMPs or other images with the bmp2raw.py script in the
+             'extras' folder. File layout (multi-byte header values are
+             little-endian):
+               - 2 bytes: signature, ASCII 'RW'
+               - 2 bytes: width in pixels
+               - 2 bytes: height in pixels
+               - 1 byte: pixel format, 1 = 16-bit 565 color (only one now)
+               - 1 byte: pixel byte order, 0 = little-endian, 1 = big-endian
+               - width * height pixels, top-to-bottom, no row padding
+    @param   filename
+             Name of raw image file to load.
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @param   transact
+             Pass 'true' if TFT and SD are on the same SPI bus, in which
+             case SPI transactions are necessary. If separate peripherals,
+             can pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+    @note    Uses the same working buffer policy as drawBMP() (see
+             setBuffer() and setBufferRows()), split into two halves that
+             are alternated so the next read can proceed while the last
+             one is going out over DMA (when not 'transact').
+*/
+ImageReturnCode Adafruit_ImageReader::drawRAW(char *filename,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y, boolean transact) {
+  // If image is being drawn off the right or bottom edge of the screen,
+  // nothing to do here. NOT an error, just a trivial clip operation.
+  if ((x >= tft.width()) || (y >= tft.height()))
+    return IMAGE_SUCCESS;
+
+  File file;
+  if (!(file = filesys->open(filename, FILE_READ)))
+    return IMAGE_ERR_FILE_NOT_FOUND;
+  Adafruit_ImageFile source(file);
+  ImageReturnCode status = drawRAW(source, tft, x, y, transact);
+  file.close();
+  return status;
+}
+
+/*!
+    @brief   Draws "panel-native" raw image (see drawRAW() for files) from
+             an Adafruit_ImageSource directly to SPITFT screen, e.g. one
+             selected in an Adafruit_ImagePack.
+    @param   source
+             Adafruit_ImageSource holding the raw image (seekable sources
+             are rewound to its start, forward-only ones must be there
+             already).
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @param   transact
+             Pass 'true' if TFT and the source are on the same SPI bus, in
+             which case SPI transactions are necessary. If separate
+             peripherals, can pass 'false'.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::drawRAW(Adafruit_ImageSource &source,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y, boolean transact) {
+  ImageReturnCode status = IMAGE_ERR_FORMAT; // Guilty until innocent
+  uint8_t hdr[8];                        // Raw image header
+  int rawWidth = 0, rawHeight = 0;       // Image width & height in pixels
+  boolean bigEndian = false;             // Pixel byte order in file
+  int loadWidth, loadHeight, loadX, loadY; // Clipped region
+  uint8_t *work = NULL, *workAlloc = NULL;         // Working buffer
+
+  // If image is being drawn off the right or bottom edge of the screen,
+  // nothing to do here. NOT an error, just a trivial clip operation.
+  if ((x >= tft.width()) || (y >= tft.height()))
+    return IMAGE_SUCCESS;
+
+  if (source.seekable())
+    source.seek(0);
+  if ((source.read(hdr, sizeof hdr) == sizeof hdr) &&
+      rawHeader(hdr, &rawWidth, &rawHeight, &bigEndian))
+    status = IMAGE_SUCCESS;
+
+  // Crop area to be loaded
+  loadWidth = rawWidth;
+  loadHeight = rawHeight;
+  clipToScreen(tft, x, y, loadX, loadY, loadWidth, loadHeight);
+
+  if ((status == IMAGE_SUCCESS) && (loadWidth > 0) && (loadHeight > 0)) {
+    // Two buffers of one or more scanlines each. If not cropped
+    // horizontally, scanlines are contiguous in the file and in
+    // the screen's address window, so several can be read and
+    // written at once.
+    uint32_t rowBytes = loadWidth * sizeof(uint16_t);
+    uint32_t rows = (loadWidth == rawWidth) ? bufRows : 1;
+    if (userBuf && (userBufLen >= (2 * rowBytes))) {
+      work = userBuf;
+      if (loadWidth == rawWidth) // Use all of it
+        rows = userBufLen / (2 * rowBytes);
+    }
+    if (rows > (uint32_t)loadHeight)
+      rows = loadHeight;
+    if (!work)
+      work = workAlloc =
+          (uint8_t *)allocator->alloc(2 * rows * rowBytes, IMAGE_MEM_WORK);
+    if (work) {
+      uint16_t *buf[2] = {(uint16_t *)work,
+                          (uint16_t *)&work[rows * rowBytes]};
+      uint8_t which = 0;
+      tft.startWrite(); // Start SPI (regardless of transact)
+      tft.setAddrWindow(x, y, loadWidth, loadHeight);
+      for (int row = 0; row < loadHeight; row += rows) {
+        uint32_t n = loadHeight - row;
+        if (n > rows)
+          n = rows;
+        uint32_t pos = 8 + ((row + loadY) * rawWidth + loadX) * 2;
+        // The buffer being read into was issued two writes ago,
+        // and SPITFT doesn't start a DMA transfer until the prior
+        // one is done, so it's free; only transact needs waiting.
+        if (transact) {
+          tft.dmaWait();  // Finish any DMA in progress and
+          tft.endWrite(); // end TFT SPI transact
+        }
+        if (source.position() != pos)
+          source.seek(pos);
+        source.read((uint8_t *)buf[which], n * rowBytes);
+        if (transact)
+          tft.startWrite(); // Start TFT SPI transact
+        tft.writePixels(buf[which], n * loadWidth, false, bigEndian);
+        which ^= 1;
+        yield(); // Keep ESP8266 happy
+      }
+      tft.dmaWait();  // Let last DMA transfer finish, then
+      tft.endWrite(); // end TFT (regardless of transact)
+      if (workAlloc)
+        allocator->release(workAlloc, IMAGE_MEM_WORK);
+    } else {
+      status = IMAGE_ERR_MALLOC;
+    }
+  }
+
+  return status;
+}
+
+/*!
+    @brief   Draws "panel-native" raw image (see drawRAW() for files) from
+             memory directly to SPITFT screen. The image's pixels are
+             issued to the screen in place, with no reading or copying,
+             which makes this the fastest way to draw, e.g. from flash
+             memory-mapped with mapPartition() on ESP32.
+    @param   data
+             Pointer to start of raw image (header). Must be 16-bit aligned.
+    @param   tft
+             Adafruit_SPITFT object (e.g. one of the Adafruit TFT or OLED
+             displays that subclass Adafruit_SPITFT).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, IMAGE_ERR_FORMAT if data isn't a raw image).
+*/
+ImageReturnCode Adafruit_ImageReader::drawRAW(const uint8_t *data,
+                                              Adafruit_SPITFT &tft, int16_t x,
+                                              int16_t y) {
+  int rawWidth, rawHeight;                 // Image width & height in pixels
+  boolean bigEndian;                       // Pixel byte order
+  int loadWidth, loadHeight, loadX, loadY; // Clipped region
+
+  if (!data || !rawHeader(data, &rawWidth, &rawHeight, &bigEndian))
+    return IMAGE_ERR_FORMAT;
+
+  loadWidth = rawWidth;
+  loadHeight = rawHeight;
+  clipToScreen(tft, x, y, loadX, loadY, loadWidth, loadHeight);
+  if ((loadWidth > 0) && (loadHeight > 0)) {
+    // SPITFT doesn't modify pixel data passed to it, casting away
+    // const here is OK.
+    uint16_t *pixels = (uint16_t *)&data[8];
+    tft.startWrite();
+    tft.setAddrWindow(x, y, loadWidth, loadHeight);
+    if (loadWidth == rawWidth) { // Scanlines are contiguous, one write
+      tft.writePixels(&pixels[loadY * rawWidth], loadWidth * loadHeight,
+                      false, bigEndian);
+    } else { // Cropped, a write per scanline
+      for (int row = 0; row < loadHeight; row++)
+        tft.writePixels(&pixels[(row + loadY) * rawWidth + loadX], loadWidth,
+                        false, bigEndian);
+    }
+    tft.dmaWait(); // Let last DMA transfer finish, then
+    tft.endWrite();
+  }
+  return IMAGE_SUCCESS;
+}
+
+#if defined(ESP32)
+/*!
+    @brief   Memory-map a data partition in flash (or part of one), for
+             drawing images in it in place with drawRAW(). Images can be
+             written to such a partition (e.g. concatenated, at known
+             offsets) with esptool.py or parttool.py. Only one partition
+             mapping is held by the reader at a time.
+    @param   label
+             Partition label, as given in the partition table CSV.
+    @param   offset
+             Start of region to map, in bytes from start of partition.
+    @param   size
+             Size of region to map in bytes, or 0 (default) for the rest
+             of the partition.
+    @return  Pointer to start of mapped region, or NULL if the partition
+             isn't found or can't be mapped. Valid until unmapPartition()
+             or another mapPartition() call.
+*/
+const uint8_t *Adafruit_ImageReader::mapPartition(const char *label,
+                                                  uint32_t offset,
+                                                  uint32_t size) {
+  const esp_partition_t *part;
+  const void *ptr;
+
+  unmapPartition(); // Release any prior mapping
+
+  if (!(part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                        ESP_PARTITION_SUBTYPE_ANY, label)) ||
+      (offset >= part->size))
+    return NULL;
+  if (!size || (size > (part->size - offset)))
+    size = part->size - offset;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_partition_mmap_handle_t handle;
+  if (esp_partition_mmap(part, offset, size, ESP_PARTITION_MMAP_DATA, &ptr,
+                         &handle) != ESP_OK)
+#else
+  spi_flash_mmap_handle_t handle;
+  if (esp_partition_mmap(part, offset, size, SPI_FLASH_MMAP_DATA, &ptr,
+                         &handle) != ESP_OK)
+#endif
+    return NULL;
+  mapHandle = handle;
+  mapped = true;
+  return (const uint8_t *)ptr;
+}
+
+/*!
+    @brief   Release partition mapping made with mapPartition(), if any.
+             Pointers into it may no longer be used.
+    @return  None (void).
+*/
+void Adafruit_ImageReader::unmapPartition(void) {
+  if (mapped) {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_munmap(mapHandle);
+#else
+    spi_flash_munmap(mapHandle);
+#endif
+    mapped = false;
+  }
+}
+#endif
+
+/*!
+    @brief   Parse header (and color palette, if any) of BMP file that was
+             just opened in an Adafruit_BMPInfo object. Only the BMP
+             variants that coreBMP() can actually handle are accepted.
+             QOI images are recognized by signature and accepted too.
+    @param   bmp
+             Adafruit_BMPInfo object, with its file open and positioned
+             at the start.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::parseBMP(Adafruit_BMPInfo &bmp) {
+  Adafruit_ImageFile bmpFile(bmp.file); // Read from BMP file unless
+  Adafruit_ImageSource &in =            // opened from a source
+      bmp.source ? *bmp.source : bmpFile;
+  uint32_t headerSize;      // Indicates BMP version
+  uint8_t planes;           // BMP planes
+  uint32_t compression = 0; // BMP compression mode
+  uint32_t colors = 0;      // Number of colors in palette
+  uint32_t masks[3] = {0x7C00, 0x03E0, 0x001F}; // 16-bit R,G,B masks (555)
+  uint8_t bgr[4];           // Palette entry color
+
+  // Parse BMP header. 0x4D42 (ASCII 'BM') is the Windows BMP signature.
+  // There are other values possible in a .BMP file but these are super
+  // esoteric (e.g. OS/2 struct bitmap array) and NOT supported here!
+  // 0x6F71 (ASCII 'qo') may be the start of a QOI image instead.
+  uint16_t signature = readLE16(in);
+  if (signature == 0x6F71) {
+    // QOI header: rest of "qoif" signature, big-endian width & height,
+    // channels (3 = RGB, 4 = RGBA), colorspace (ignored). Pixels are
+    // decoded as 24- or 32-bit BMP-style B,G,R(,A), top-to-bottom, so
+    // everything past decoding (565, clipping, output) is shared.
+    uint8_t hdr[12];
+    if ((in.read(hdr, sizeof hdr) != sizeof hdr) || (hdr[0] != 'i') ||
+        (hdr[1] != 'f') || ((hdr[10] != 3) && (hdr[10] != 4)))
+      return IMAGE_ERR_FORMAT;
+    uint32_t w = ((uint32_t)hdr[2] << 24) | ((uint32_t)hdr[3] << 16) |
+                 (hdr[4] << 8) | hdr[5],
+             h = ((uint32_t)hdr[6] << 24) | ((uint32_t)hdr[7] << 16) |
+                 (hdr[8] << 8) | hdr[9];
+    if (!w || !h || (w > 0x7FFF) || (h > 0x7FFF)) // Too big for GFX
+      return IMAGE_ERR_FORMAT;
+    bmp.bmpWidth = w;
+    bmp.bmpHeight = h;
+    bmp.depth = hdr[10] * 8;
+    bmp.alpha = (hdr[10] == 4);
+    bmp.compression = COMPRESS_QOI;
+    bmp.flip = false;          // Always top-to-bottom
+    bmp.offset = 14;           // Encoded data follows header
+    bmp.rowSize = w * hdr[10]; // Decoded scanline, no padding
+    return IMAGE_SUCCESS;
+  }
+  if (signature != 0x4D42) // BMP signature
+    return IMAGE_ERR_FORMAT;
+  (void)readLE32(in);           // Read & ignore file size
+  (void)readLE32(in);           // Read & ignore creator bytes
+  bmp.offset = readLE32(in);    // Start of image data
+  // Read DIB header
+  headerSize = readLE32(in);
+  bmp.bmpWidth = readLE32(in);
+  bmp.bmpHeight = readLE32(in);
+  // If bmpHeight is negative, image is in top-down order.
+  // This is not canon but has been observed in the wild.
+  if (bmp.bmpHeight < 0) {
+    bmp.bmpHeight = -bmp.bmpHeight;
+    bmp.flip = false;
+  }
+  planes = readLE16(in);
+  bmp.depth = readLE16(in); // Bits per pixel
+  // Compression mode is present in later BMP versions (default = none)
+  if (headerSize > 12) {
+    compression = readLE32(in);
+    (void)readLE32(in);    // Raw bitmap data size; ignore
+    (void)readLE32(in);    // Horizontal resolution, ignore
+    (void)readLE32(in);    // Vertical resolution, ignore
+    colors = readLE32(in); // Number of colors in palette, or 0 for 2^depth
+    (void)readLE32(in);    // Number of colors used (ignore)
+  }
+
+  // Uncompressed, run-length encoded 8-bit (BI_RLE8) or 4-bit (BI_RLE4),
+  // or 16- or 32-bit with color masks (BI_BITFIELDS). RLE images are
+  // always stored bottom-to-top.
+  if ((planes != 1) || (compression > 3) ||
+      ((compression == 1) && ((bmp.depth != 8) || !bmp.flip)) ||
+      ((compression == 2) && ((bmp.depth != 4) || !bmp.flip)) ||
+      ((compression == 3) &&
+       (((bmp.depth != 16) && (bmp.depth != 32)) || (headerSize < 40))))
+    return IMAGE_ERR_FORMAT;
+  bmp.compression = compression;
+  if ((bmp.depth != 32) && (bmp.depth != 24) && (bmp.depth != 16) &&
+      (bmp.depth != 8) && (bmp.depth != 4) &&
+      (bmp.depth != 1)) // BGRA, BGR, 16-bit or palettized
+    return IMAGE_ERR_FORMAT;
+
+  if ((bmp.depth == 32) && (compression == 3)) {
+    // 32-bit pixels must be B,G,R plus a 4th byte, the only layout in
+    // common use. The 4th byte is alpha if an alpha mask is given (V4 &
+    // later headers, after the color masks), else it's unused -- as it
+    // always is in BI_RGB 32-bit data.
+    for (uint8_t c = 0; c < 3; c++)
+      masks[c] = readLE32(in);
+    uint32_t alpha = (headerSize >= 56) ? readLE32(in) : 0;
+    if ((masks[0] != 0xFF0000) || (masks[1] != 0x00FF00) ||
+        (masks[2] != 0x0000FF) || (alpha && (alpha != 0xFF000000)))
+      return IMAGE_ERR_FORMAT;
+    bmp.alpha = (alpha != 0);
+  }
+
+  if (bmp.depth == 16) {
+    // Masks immediately follow the 40-byte header, either as part of a
+    // later header version or (if BITMAPINFOHEADER) just after it. Else
+    // 16-bit data is X1R5G5B5. Each mask must be a contiguous run of at
+    // most 8 bits, which is converted to 565 in coreBMP() -- unless the
+    // masks already *are* 565, in which case no conversion is needed.
+    if (compression == 3) {
+      for (uint8_t c = 0; c < 3; c++)
+        masks[c] = readLE32(in);
+    }
+    for (uint8_t c = 0; c < 3; c++) {
+      uint32_t m = masks[c];
+      uint8_t shift = 0, bits = 0;
+      if (!m)
+        return IMAGE_ERR_FORMAT;
+      while (!(m & 1)) {
+        m >>= 1;
+        shift++;
+      }
+      while (m & 1) {
+        m >>= 1;
+        bits++;
+      }
+      if (m || (bits > 8)) // Not contiguous, or too many bits
+        return IMAGE_ERR_FORMAT;
+      bmp.maskShift[c] = shift;
+      bmp.maskBits[c] = bits;
+    }
+    bmp.rgb565 = (masks[0] == 0xF800) && (masks[1] == 0x07E0) &&
+                 (masks[2] == 0x001F);
+  }
+
+  // BMP rows are padded (if needed) to 4-byte boundary
+  bmp.rowSize = ((bmp.depth * bmp.bmpWidth + 31) / 32) * 4;
+
+  if (bmp.depth < 16) {
+    // Palette follows the DIB header. Always allocate a full 2^depth
+    // entries so any pixel value can be looked up, even if the file's
+    // palette is shorter (any missing entries are black).
+    if (!colors || (colors > (1UL << bmp.depth)))
+      colors = 1UL << bmp.depth;
+    bmp.colors = 1 << bmp.depth;
+    if (!(bmp.palette = (uint16_t *)calloc(bmp.colors, sizeof(uint16_t))))
+      return IMAGE_ERR_MALLOC;
+    if (in.position() != (14 + headerSize)) // Later BMP versions
+      in.seek(14 + headerSize);             // have longer headers
+    // Load and quantize color table (B,G,R, 4th byte ignored)
+    for (uint16_t c = 0; c < colors; c++) {
+      if (in.read(bgr, sizeof bgr) != sizeof bgr)
+        return IMAGE_ERR_FORMAT; // Truncated
+      bmp.palette[c] = ((bgr[2] & 0xF8) << 8) | ((bgr[1] & 0xFC) << 3) |
+                       (bgr[0] >> 3);
+    }
+  }
+
+  return IMAGE_SUCCESS;
+}
+
+// Decoding state of one BMP draw or load, kept from begin() (clipping,
+// buffer and canvas allocation, decoder selection, compressed stream
+// setup, TFT address window) through any number of rows() calls to end().
+// coreBMP() runs all of it in one go; Adafruit_BMPDraw steps and ePaper
+// bands instead resume where the last rows() call left off, so every
+// scanline is read and decoded once, in order, however many calls the
+// draw takes (compressed data can't be seeked into).
+struct BMPCore {
+  BMPCore(Adafruit_BMPInfo &bmp, Adafruit_ImageStats &stats);
+  ImageReturnCode begin(Adafruit_ImageReader &reader, Adafruit_SPITFT *tft,
+                        int16_t x, int16_t y, int16_t srcX, int16_t srcY,
+                        int16_t srcW, int16_t srcH, Adafruit_Image *img,
+                        boolean transact, Adafruit_ImageSink *sink);
+  void rows(int count);
+  void pause(void);
+  ImageReturnCode end(void);
+
+  // Options, set before begin()
+  int16_t band;    // If loading, canvas holds this many rows (0 = all)
+  boolean stepped; // Incremental draw: no reader task or userBuf, TFT
+                   // paused between steps
+  // Image and destination
+  Adafruit_BMPInfo &bmp;        // Opened & parsed BMP file
+  Adafruit_ImageFile bmpFile;   // Data is read from BMP file
+  Adafruit_ImageSource &in;     // unless opened from a source
+  Adafruit_ImageStats &stats;   // Reader's statistics
+  Adafruit_ImageAllocator *allocator; // Working buffers & canvas memory
+  Adafruit_SPITFT *tft;         // TFT, or NULL if to image or sink
+  Adafruit_Image *img;          // Image, if loading to RAM, else NULL
+  Adafruit_ImageSink *sink;     // Sink, if drawing to one, else NULL
+#if defined(ESP32)
+  volatile boolean *stop; // Reader's prefetchStop, ends a load if set
+#endif
+  ImageReturnCode status; // Result so far
+  boolean transact;       // SD & TFT sharing bus, use transactions
+  boolean writing;        // TFT write (SPI transaction) in progress
+  boolean reopened;       // Set if file opened for this draw or load
+  int16_t x, y;           // Position of (clipped) region on TFT or sink
+  // Source format
+  boolean seekable;      // Else forward-only (Stream)
+  uint32_t offset;       // Start of image data in file
+  int bmpWidth,          // BMP width & height in pixels
+      bmpHeight;
+  uint8_t depth;         // BMP bit depth
+  boolean rle;           // RLE8/RLE4 compressed
+  boolean qoi;           // QOI compressed
+  uint8_t srcDepth;      // Bits per pixel in src scanline
+  uint8_t scale;         // Downscale by 2^scale
+  boolean avg;           // Box average when downscaling, else point
+  boolean direct;        // 565 data, no conversion
+  boolean bottomUp;      // Scanlines processed in file order
+  boolean toRows;        // Output is 565 scanlines (TFT or sink)
+  ImageSinkFormat sinkFormat; // Pixel format for sink
+  uint16_t *quantized;   // 16-bit 5/6/5 color palette
+  uint32_t rowSize;      // >bmpWidth if scanline padding
+  boolean flip;          // BMP is stored bottom-to-top
+  uint8_t bitMask;       // Pixel value mask, if <8-bit
+  // Region & buffers
+  uint32_t rowFirst, rowBytes; // Clipped part of each scanline in file
+  uint8_t *work;         // Working buffer (heap or user-supplied)
+  uint8_t *workAlloc;    // Same, if heap-allocated (else NULL)
+  uint32_t workRows;     // Scanlines per read into working buffer
+  uint8_t *sdbuf;        // BMP read buf (part of work)
+  uint32_t bufPos;       // File position of sdbuf[0]
+  uint32_t srclen;       // Bytes of data in sdbuf
+  uint8_t *line;         // Decoded RLE or QOI scanline (part of work)
+  uint16_t *sums;        // R,G,B sums if box averaging (part of work)
+  BMPRLE rleState;       // RLE decoder state, if compressed
+  BMPQOI qoiState;       // QOI decoder state (+ rleState), if QOI
+  BMPDecoder decode;     // Scanline decoder, if not downscaling
+  BMPDecode decodeArgs;  // and its parameters
+  uint8_t *canvasBuf;    // Canvas buffer, if loading to RAM
+  uint32_t canvasStride; // Bytes per canvas row
+  uint8_t *maskBuf;      // Mask canvas buffer, if 32-bit w/alpha
+  uint32_t maskStride;   // Bytes per mask canvas row
+#if defined(ESP32)
+  BMPPipe pipe;          // Scanline reader task state, if pipelined
+  uint8_t *ring;         // Scanline buffers for reader task, if pipelined
+#endif
+  uint16_t *dest;        // TFT working buffer, or canvas buffer
+  uint16_t *destNext;    // Alternate TFT buffer (DMA ping-pong)
+  uint8_t *dest1;        // Dest ptr for 1-bit BMPs to img
+  uint8_t *dest8;        // Dest ptr for 8- & 4-bit BMPs to img
+  int loadWidth, loadHeight, // Region being loaded (clipped, scaled)
+      loadX, loadY;          // First source pixel of region
+  int spanWidth,         // Source pixels covered by region
+      srcRows;           // (= load size if not downscaled)
+  int canvasRows;        // Output rows held in canvas (band, or all)
+  int next;              // Scanlines processed so far (of srcRows)
+};
+
+// Only what end() relies on is set here, begin() does the rest
+BMPCore::BMPCore(Adafruit_BMPInfo &bmp, Adafruit_ImageStats &stats)
+    : band(0), stepped(false), bmp(bmp), bmpFile(bmp.file),
+      in(bmp.source ? *bmp.source : bmpFile), stats(stats), allocator(NULL),
+      tft(NULL), img(NULL), sink(NULL), status(IMAGE_SUCCESS),
+      writing(false), reopened(false), work(NULL), workAlloc(NULL),
+#if defined(ESP32)
+      ring(NULL),
+#endif
+      srcRows(0), canvasRows(0), next(0) {
 }
 
 /*!
-    @brief   BMP-reading function common both to the draw function (to TFT)
-             and load function (to canvas object in RAM). BMP code has been
-             centralized here so if/when more BMP format variants are added
-             in the future, it doesn't need to be implemented, debugged and
-             kept in sync in two places.
-    @param   filename
-             Name of BMP image file to load.
+    @brief   Set up a BMP draw or load: clip it, allocate the canvas (if
+             loading) and working buffers, pick the scanline decoder and
+             position the source at the first scanline needed. If drawing
+             to TFT, its write is started and address window set.
+    @param   reader
+             Adafruit_ImageReader whose settings are used.
     @param   tft
              Pointer to TFT object, if loading to screen, else NULL.
-    @param   dest
-             Working buffer for loading 16-bit TFT pixel data, if loading to
-             screen, else NULL.
     @param   x
              Horizontal offset in pixels (if loading to screen).
     @param   y
              Vertical offset in pixels (if loading to screen).
+    @param   srcX
+             Left edge of rectangle within BMP image to draw or load.
+    @param   srcY
+             Top edge of rectangle within BMP image to draw or load.
+    @param   srcW
+             Width of rectangle within BMP image to draw or load.
+    @param   srcH
+             Height of rectangle within BMP image to draw or load.
     @param   img
              Pointer to Adafruit_Image object, if loading to RAM (or NULL
              if loading to screen).
@@ -304,298 +2928,918 @@ ImageReturnCode Adafruit_ImageReader::loadBMP(char *filename,
              Use SPI transactions; 'true' is needed only if loading to screen
              and it's on the same SPI bus as the SD card. Other situations
              can use 'false'.
-    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
-             completion, other values on failure).
+    @param   sink
+             Pointer to Adafruit_ImageSink object, if drawing to one (tft
+             and img are then NULL), else NULL.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS if rows()
+             can proceed, or if there's nothing to draw, with srcRows 0;
+             other values on failure). end() must be called either way.
 */
-ImageReturnCode Adafruit_ImageReader::coreBMP(
-    char *filename,       // SD file to load
-    Adafruit_SPITFT *tft, // Pointer to TFT object, or NULL if to image
-    uint16_t *dest,       // TFT working buffer, or NULL if to canvas
-    int16_t x,            // Position if loading to TFT (else ignored)
+ImageReturnCode BMPCore::begin(
+    Adafruit_ImageReader &reader, // Settings & filesystem
+    Adafruit_SPITFT *tft,  // Pointer to TFT object, or NULL if to image
+    int16_t x,             // Position if loading to TFT (else ignored)
     int16_t y,
+    int16_t srcX,          // Rectangle within BMP to draw or load
+    int16_t srcY,
+    int16_t srcW,
+    int16_t srcH,
     Adafruit_Image *img, // NULL if load-to-screen
-    boolean transact) {  // SD & TFT sharing bus, use transactions
-
-  ImageReturnCode status = IMAGE_ERR_FORMAT; // IMAGE_SUCCESS on valid file
-  uint32_t offset;                           // Start of image data in file
-  uint32_t headerSize;                       // Indicates BMP version
-  int bmpWidth, bmpHeight;                   // BMP width & height in pixels
-  uint8_t planes;                            // BMP planes
-  uint8_t depth;                             // BMP bit depth
-  uint32_t compression = 0;                  // BMP compression mode
-  uint32_t colors = 0;                       // Number of colors in palette
-  uint16_t *quantized = NULL;                // 16-bit 5/6/5 color palette
-  uint32_t rowSize;                          // >bmpWidth if scanline padding
-  uint8_t sdbuf[3 * BUFPIXELS];              // BMP read buf (R+G+B/pixel)
-#if ((3 * BUFPIXELS) <= 255)
-  uint8_t srcidx = sizeof sdbuf; // Current position in sdbuf
-#else
-  uint16_t srcidx = sizeof sdbuf;
+    boolean transact,    // SD & TFT sharing bus, use transactions
+    Adafruit_ImageSink *sink) { // Else scanlines to here, if set
+
+  File &file = bmp.file; // BMP file (opened below if needed)
+  this->tft = tft;
+  this->img = img;
+  this->sink = sink;
+  this->transact = transact;
+  allocator = reader.allocator;
+#if defined(ESP32)
+  stop = &reader.prefetchStop;
 #endif
-  uint32_t destidx = 0;
-  uint8_t *dest1 = NULL;     // Dest ptr for 1-bit BMPs to img
-  boolean flip = true;       // BMP is stored bottom-to-top
-  uint32_t bmpPos = 0;       // Next pixel position in file
-  int loadWidth, loadHeight, // Region being loaded (clipped)
-      loadX, loadY;          // "
-  int row, col;              // Current pixel pos.
-  uint8_t r, g, b;           // Current pixel color
-  uint8_t bitIn = 0;         // Bit number for 1-bit data in
-  uint8_t bitOut = 0;        // Column mask for 1-bit data out
+  seekable = in.seekable();
+  offset = bmp.offset;
+  bmpWidth = bmp.bmpWidth;
+  bmpHeight = bmp.bmpHeight;
+  depth = bmp.depth;
+  rle = (bmp.compression == 1) || (bmp.compression == 2);
+  qoi = (bmp.compression == COMPRESS_QOI);
+  srcDepth = rle ? 8 : depth;
+  scale = reader.scaleShift;
+  avg = scale && reader.scaleAvg && (depth >= 16);
+  direct = (depth == 16) && bmp.rgb565 && !scale;
+  toRows = tft || sink;
+  sinkFormat = IMAGE_SINK_565;
+  quantized = bmp.palette;
+  rowSize = bmp.rowSize;
+  flip = bmp.flip;
+  bitMask = (depth < 8) ? ((1 << depth) - 1) : 0xFF;
+  workRows = 1;
+  sdbuf = line = NULL;
+  sums = NULL;
+  bufPos = srclen = 0;
+  decode = NULL;
+  canvasBuf = maskBuf = NULL;
+  canvasStride = maskStride = 0;
+  dest = destNext = NULL;
+  dest1 = dest8 = NULL;
+  spanWidth = srcRows = next = 0;
+  int16_t outWidth = tft ? tft->width() : sink ? sink->width() : 0,
+          outHeight = tft ? tft->height() : sink ? sink->height() : 0;
 
   // If an Adafruit_Image object is passed and currently contains anything,
   // free its contents as it's about to be overwritten with new stuff.
-  if (img)
+  // If canvas reuse is enabled, that's decided where it's allocated
+  // below instead, and the image is freed if returning an error.
+  if (img && !reader.reuseCanvas)
     img->dealloc();
 
   // If BMP is being drawn off the right or bottom edge of the screen,
   // nothing to do here. NOT an error, just a trivial clip operation.
-  if (tft && ((x >= tft->width()) || (y >= tft->height())))
-    return IMAGE_SUCCESS;
+  if (toRows && ((x >= outWidth) || (y >= outHeight)))
+    return status = IMAGE_SUCCESS;
 
-  // Open requested file on SD card
-  if (!(file = filesys->open(filename, FILE_READ))) {
-    return IMAGE_ERR_FILE_NOT_FOUND;
+  if (!depth) // Handle was never successfully opened, or has been closed
+    return status = IMAGE_ERR_FILE_NOT_FOUND;
+
+  // Clip source rectangle to image bounds. If clipped on the left or
+  // top, the screen position moves to match, so pixels still land where
+  // they would have.
+  if (srcX < 0) {
+    srcW += srcX;
+    x -= srcX;
+    srcX = 0;
+  }
+  if (srcY < 0) {
+    srcH += srcY;
+    y -= srcY;
+    srcY = 0;
   }
+  if ((srcX + srcW) > bmpWidth)
+    srcW = bmpWidth - srcX;
+  if ((srcY + srcH) > bmpHeight)
+    srcH = bmpHeight - srcY;
+  // If downscaling, output is the number of whole 2^scale squares
+  srcW = (srcW > 0) ? (srcW >> scale) : 0;
+  srcH = (srcH > 0) ? (srcH >> scale) : 0;
+  if (!srcW || !srcH) // Nothing to draw, can't load nothing
+    return status = img ? IMAGE_ERR_FORMAT : IMAGE_SUCCESS;
 
-  // Parse BMP header. 0x4D42 (ASCII 'BM') is the Windows BMP signature.
-  // There are other values possible in a .BMP file but these are super
-  // esoteric (e.g. OS/2 struct bitmap array) and NOT supported here!
-  if (readLE16() == 0x4D42) { // BMP signature
-    (void)readLE32();         // Read & ignore file size
-    (void)readLE32();         // Read & ignore creator bytes
-    offset = readLE32();      // Start of image data
-    // Read DIB header
-    headerSize = readLE32();
-    bmpWidth = readLE32();
-    bmpHeight = readLE32();
-    // If bmpHeight is negative, image is in top-down order.
-    // This is not canon but has been observed in the wild.
-    if (bmpHeight < 0) {
-      bmpHeight = -bmpHeight;
-      flip = false;
-    }
-    planes = readLE16();
-    depth = readLE16(); // Bits per pixel
-    // Compression mode is present in later BMP versions (default = none)
-    if (headerSize > 12) {
-      compression = readLE32();
-      (void)readLE32();    // Raw bitmap data size; ignore
-      (void)readLE32();    // Horizontal resolution, ignore
-      (void)readLE32();    // Vertical resolution, ignore
-      colors = readLE32(); // Number of colors in palette, or 0 for 2^depth
-      (void)readLE32();    // Number of colors used (ignore)
-      // File position should now be at start of palette (if present)
-    }
-    if (!colors)
-      colors = 1 << depth;
-
-    loadWidth = bmpWidth;
-    loadHeight = bmpHeight;
-    loadX = 0;
-    loadY = 0;
-    if (tft) {
-      // Crop area to be loaded (if destination is TFT)
-      if (x < 0) {
-        loadX = -x;
-        loadWidth += x;
-        x = 0;
+  if (!seekable && (in.position() > offset)) // Already read, can't go back
+    return status = IMAGE_ERR_FILE_NOT_FOUND;
+
+  if (!bmp.source && !file) { // Opened with keepOpen false, re-open file
+    if (bmp.filename)
+      STAT_TIME(stats, openMicros,
+                file = reader.filesys->open(bmp.filename, FILE_READ));
+    if (!bmp.filename || !file)
+      return status = IMAGE_ERR_FILE_NOT_FOUND;
+    reopened = true;
+  }
+
+  loadWidth = srcW;
+  loadHeight = srcH;
+  loadX = srcX;
+  loadY = srcY;
+  if (toRows) {
+    // Crop area to be loaded (if destination is TFT or sink)
+    if (x < 0) {
+      loadX += (-x) << scale;
+      loadWidth += x;
+      x = 0;
+    }
+    if (y < 0) {
+      loadY += (-y) << scale;
+      loadHeight += y;
+      y = 0;
+    }
+    if ((x + loadWidth) > outWidth)
+      loadWidth = outWidth - x;
+    if ((y + loadHeight) > outHeight)
+      loadHeight = outHeight - y;
+  }
+  this->x = x;
+  this->y = y;
+  // Canvas holds all rows, or a band of them (reused for each band)
+  canvasRows = ((band > 0) && (band < loadHeight)) ? band : loadHeight;
+
+  if (img) {
+    // Loading to RAM -- allocate GFX canvas type for depth. If reusing
+    // canvases and the image holds one of the same type, size and
+    // allocator (and palette size, and mask or not), it's kept and
+    // overwritten instead.
+    uint8_t format = (depth >= 16) ? IMAGE_16
+                     : (depth == 1) ? IMAGE_1
+                                    : IMAGE_8;
+    uint16_t colors = (quantized && (format != IMAGE_16)) ? bmp.colors : 0;
+    if ((img->format != format) || (img->width() != loadWidth) ||
+        (img->height() != canvasRows) || (img->colors != colors) ||
+        (img->allocator != allocator) || (!img->mask != !bmp.alpha))
+      img->dealloc(); // No match (or not reusing, already freed)
+    img->allocator = allocator; // Image's memory is freed the same way
+    status = IMAGE_ERR_MALLOC;  // Assume won't fit to start
+    if (format == IMAGE_16) {
+      if (img->canvas.canvas16 ||
+          (img->canvas.canvas16 = newCanvas<GFXcanvas16, uint16_t>(
+               allocator, loadWidth, canvasRows, loadWidth * canvasRows * 2))) {
+        dest = img->canvas.canvas16->getBuffer();
+        img->format = IMAGE_16; // Is a GFX 16-bit canvas type
+      }
+      if (dest && bmp.alpha) { // 32-bit with alpha also gets a 1-bit mask
+        maskStride = (loadWidth + 7) / 8;
+        if (img->mask || (img->mask = newCanvas<GFXcanvas1, uint8_t>(
+                              allocator, loadWidth, canvasRows,
+                              maskStride * canvasRows)))
+          maskBuf = img->mask->getBuffer();
+        else
+          dest = NULL;
+      }
+    } else if (format == IMAGE_1) {
+      if (img->canvas.canvas1 ||
+          (img->canvas.canvas1 = newCanvas<GFXcanvas1, uint8_t>(
+               allocator, loadWidth, canvasRows,
+               ((loadWidth + 7) / 8) * canvasRows))) {
+        dest1 = img->canvas.canvas1->getBuffer();
+        img->format = IMAGE_1; // Is a GFX 1-bit canvas type
+      }
+    } else {
+      // 8- and 4-bit images are stored as palette indices, one per byte
+      if (img->canvas.canvas8 ||
+          (img->canvas.canvas8 = newCanvas<GFXcanvas8, uint8_t>(
+               allocator, loadWidth, canvasRows, loadWidth * canvasRows))) {
+        dest8 = img->canvas.canvas8->getBuffer();
+        img->format = IMAGE_8; // Is a GFX 8-bit canvas type
+      }
+    }
+    if (colors && (dest1 || dest8)) {
+      // Image gets its own copy of palette, handle keeps the original
+      if (img->palette ||
+          (img->palette = (uint16_t *)allocator->alloc(
+               colors * sizeof(uint16_t), IMAGE_MEM_PALETTE))) {
+        memcpy(img->palette, quantized, colors * sizeof(uint16_t));
+        img->colors = colors;
+      } else {
+        dest1 = NULL;
+        dest8 = NULL;
       }
-      if (y < 0) {
-        loadY = -y;
-        loadHeight += y;
-        y = 0;
+    }
+    if (!(dest || dest1 || dest8)) // Unsupported format, alloc failed, etc.
+      return status;
+    status = IMAGE_SUCCESS;
+  }
+
+  if ((loadWidth <= 0) || (loadHeight <= 0)) // Clip top/left
+    return status;
+
+  // Portion of each scanline that's actually needed (clipped),
+  // relative to start of scanline in file.
+  spanWidth = loadWidth << scale;
+  uint32_t bitFirst = loadX * depth;
+  rowFirst = bitFirst / 8;
+  rowBytes = ((bitFirst & 7) + spanWidth * depth + 7) / 8;
+
+  // Choose scanline decoder once, rather than testing depth and
+  // destination for every pixel. Decoded RLE scanlines are 8-bit
+  // indices, QOI are B,G,R(,A), both starting at the first pixel.
+  // Sinks get native-order 565 (24- & 32-bit to TFT is byte-swapped,
+  // see decode24()), unless it's 565 from the file as-is on a
+  // big-endian device.
+  decode = bmpDecoder(srcDepth, toRows, tft != NULL);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  if (direct)
+    sinkFormat = IMAGE_SINK_565_SWAP;
+#endif
+  decodeArgs.palette = quantized;
+  decodeArgs.maskShift = bmp.maskShift;
+  decodeArgs.maskBits = bmp.maskBits;
+  decodeArgs.bitFirst = (rle || qoi) ? 0 : (bitFirst & 7);
+  // RLE (and 565 into canvas, which has no seek-back read buffer, and
+  // any bottom-to-top image from a forward-only source) goes in file
+  // order, bottom-up if flipped. Not 565 into a band canvas though, as
+  // bands are wanted top-down where possible (see ePaper drawBMP()).
+  bottomUp = rle ||
+             (flip && ((img && direct && (canvasRows == loadHeight)) ||
+                       !seekable));
+  if (dest) { // Canvas16
+    canvasBuf = (uint8_t *)dest;
+    canvasStride = loadWidth * 2;
+  } else if (dest8) {
+    canvasBuf = dest8;
+    canvasStride = loadWidth;
+  } else if (dest1) {
+    canvasBuf = dest1;
+    canvasStride = (loadWidth + 7) / 8;
+  }
+
+  // Working buffer: if drawing to TFT, two alternating
+  // scanlines of 565 pixels (one can be filled while the other
+  // is out via non-blocking DMA), followed by the BMP read
+  // buffer. If not cropped horizontally, as many whole BMP
+  // scanlines as requested (or as fit in the user's buffer)
+  // are read at once, else one clipped scanline at a time.
+  // RLE data is read as a stream in chunks of that same size,
+  // and is decoded into a scanline of palette indices placed
+  // between the 565 scanlines and read buffer (QOI likewise,
+  // into a scanline of 24- or 32-bit pixels). 565 data needs
+  // no 565 scanlines, it's issued to the TFT from the read
+  // buffer, or read straight into a canvas (no buffer at all).
+  // Box-averaged downscaling adds R,G,B sums per output pixel.
+  // Point-sampled downscaling reads only the scanlines it uses,
+  // never several at once.
+  uint32_t destBytes =
+      (toRows && !direct) ? loadWidth * 2 * sizeof(uint16_t) : 0;
+  uint32_t sumBytes = avg ? loadWidth * 3 * sizeof(uint16_t) : 0;
+  uint32_t lineBytes = rle ? spanWidth : qoi ? spanWidth * (depth / 8) : 0;
+  uint32_t readBytes = rowBytes;
+  boolean wholeRows =
+      rle || qoi || ((spanWidth == bmpWidth) && (!scale || avg));
+#if defined(ESP32)
+  boolean piped = tft && (reader.pipeCore >= 0) && !stepped && !rle &&
+                  !qoi && !scale && seekable; // Pipeline
+  if (piped)
+    wholeRows = false; // task reads (one row, in case of fallback)
+#endif
+  destBytes += sumBytes + lineBytes; // Fixed part of working buffer
+  if (wholeRows)
+    readBytes = (reader.bufRows - 1) * rowSize + rowBytes;
+  // An incremental draw keeps its buffer between steps, when other
+  // calls may be using userBuf, so it always gets its own.
+  if (reader.userBuf && !stepped &&
+      (reader.userBufLen >= (destBytes + rowBytes))) {
+    work = reader.userBuf;
+    if (wholeRows) // Use all of it
+      readBytes = reader.userBufLen - destBytes;
+  }
+  if (!work && !(img && direct))
+    work = workAlloc = (uint8_t *)allocator->alloc(destBytes + readBytes,
+                                                   IMAGE_MEM_WORK);
+  if (work) {
+    if (toRows && !direct) {
+      dest = (uint16_t *)work;
+      destNext = &dest[loadWidth]; // Ping-pong pair
+    }
+    sums = (uint16_t *)&work[destBytes - lineBytes - sumBytes];
+    line = &work[destBytes - lineBytes];
+    sdbuf = &work[destBytes];
+    if (wholeRows && (readBytes >= rowBytes))
+      workRows = (readBytes - rowBytes) / rowSize + 1;
+    STAT_MAX(stats, peakBuffer, destBytes + readBytes);
+  } else if (!(img && direct)) {
+    return status = IMAGE_ERR_MALLOC;
+  }
+
+#if defined(ESP32)
+  if (work && piped) {
+    // Pipelined draw: hand off file reading to a task on the
+    // other core. Anything not allocated falls back on the
+    // normal read-convert-write method.
+    uint8_t pipeDepth = reader.pipeDepth;
+    pipe.in = &in;
+    pipe.offset = offset;
+    pipe.rowSize = rowSize;
+    pipe.first = rowFirst;
+    pipe.rowBytes = rowBytes;
+    pipe.bmpHeight = bmpHeight;
+    pipe.loadY = loadY;
+    pipe.loadHeight = loadHeight;
+    pipe.flip = flip;
+    pipe.empty = xQueueCreate(pipeDepth, sizeof(uint8_t *));
+    pipe.full = xQueueCreate(pipeDepth, sizeof(uint8_t *));
+    pipe.done = xSemaphoreCreateBinary();
+#if defined(IMAGEREADER_STATS)
+    pipe.stats = &stats;
+#endif
+    ring = (uint8_t *)allocator->alloc(pipeDepth * pipe.rowBytes,
+                                       IMAGE_MEM_WORK);
+    if (ring && pipe.empty && pipe.full && pipe.done) {
+      for (uint8_t i = 0; i < pipeDepth; i++) {
+        uint8_t *buf = &ring[i * pipe.rowBytes];
+        xQueueSend(pipe.empty, &buf, portMAX_DELAY);
       }
-      if ((x + loadWidth) > tft->width())
-        loadWidth = tft->width() - x;
-      if ((y + loadHeight) > tft->height())
-        loadHeight = tft->height() - y;
+      if (xTaskCreatePinnedToCore(bmpPipeTask, "bmpPipe", 4096, &pipe,
+                                  uxTaskPriorityGet(NULL), NULL,
+                                  reader.pipeCore) != pdPASS) {
+        allocator->release(ring, IMAGE_MEM_WORK);
+        ring = NULL;
+      }
+    } else if (ring) {
+      allocator->release(ring, IMAGE_MEM_WORK);
+      ring = NULL;
+    }
+    if (ring) {
+      STAT_MAX(stats, peakBuffer,
+               destBytes + readBytes + pipeDepth * pipe.rowBytes);
+    }
+    if (!ring) { // Fallback, task isn't running
+      if (pipe.empty)
+        vQueueDelete(pipe.empty);
+      if (pipe.full)
+        vQueueDelete(pipe.full);
+      if (pipe.done)
+        vSemaphoreDelete(pipe.done);
+    }
+  }
+#endif
+
+  if ((rle || qoi) && work) {
+    // Compressed scanlines can't be seeked to, the whole stream
+    // is decoded from the start. RLE is in bottom-to-top order,
+    // so skip over any scanlines below the clipped area first
+    // (QOI: above it, top-to-bottom); the scanline loop then
+    // stops at the far edge of the area, not reading any further.
+    rleState.in = &in;
+    rleState.tft = NULL; // No bus handoff until startWrite() below
+    rleState.transact = transact;
+    rleState.buf = sdbuf;
+    rleState.bufSize = readBytes;
+#if defined(ARDUINO_NRF52_ADAFRUIT)
+    if (rleState.bufSize > 512) // See NRF52 read workaround, bmpRead()
+      rleState.bufSize = 512;
+#endif
+    rleState.len = rleState.idx = 0;
+    rleState.depth = depth;
+    rleState.col = rleState.skip = 0;
+    rleState.eof = false;
+#if defined(IMAGEREADER_STATS)
+    rleState.stats = &stats;
+#endif
+    STAT_TIME(stats, readMicros, in.seek(offset));
+    STAT_ADD(stats, seeks, 1);
+    if (qoi) {
+      memset(qoiState.index, 0, sizeof qoiState.index);
+      qoiState.px[0] = qoiState.px[1] = qoiState.px[2] = 0;
+      qoiState.px[3] = 255;
+      qoiState.run = 0;
+      qoiState.width = bmpWidth;
+      qoiState.bytes = depth / 8;
+      for (int row = loadY; row > 0; row--)
+        qoiRow(rleState, qoiState, NULL, 0, 0);
+    } else {
+      for (int row = bmpHeight - loadY - (loadHeight << scale); row > 0;
+           row--)
+        rleRow(rleState, NULL, 0, 0);
+    }
+    rleState.tft = tft;
+  }
+
+  if (tft) {
+    STAT_START(t);
+    tft->startWrite(); // Start SPI (regardless of transact)
+    writing = true;
+    STAT_ADD(stats, transactions, 1);
+    if (!bottomUp) // Bottom-up sets a window per scanline, see rows()
+      tft->setAddrWindow(x, y, loadWidth, loadHeight);
+    STAT_SINCE(stats, pushMicros, t);
+  } else if (sink) {
+    sink->begin(x, y, loadWidth, loadHeight);
+  }
+
+  srcRows = loadHeight << scale; // rows() can go now
+  return status;
+}
+
+/*!
+    @brief   Read, convert and output the next scanlines of a BMP draw or
+             load set up by begin(), in processing order (bottom-up for
+             RLE, see bottomUp). Resumes the TFT write if pause()d,
+             setting the address window again for the rows left.
+    @param   count
+             Number of source scanlines (fewer if near the end). Steps
+             should be whole output rows, i.e. multiples of 2^scale.
+    @return  None (void). Status is in 'status'; IMAGE_ERR_CANCELED ends
+             the scanlines early.
+*/
+void BMPCore::rows(int count) {
+  uint8_t *src;         // Current scanline in sdbuf (or pipe ring)
+  uint32_t bmpPos;      // Next pixel position in file
+  uint32_t destidx = 0; // Output position in dest, dest1 or dest8
+  uint8_t bitOut = 0;   // Column mask for 1-bit data out
+  int row, col;         // Current pixel pos. (row in source pixels)
+  int outRow;           // Current output row (= row if not scaled)
+  int canvasRow;        // Row of canvas it goes in (outRow, or in band)
+  uint8_t r, g, b;      // Current pixel color
+
+  if (tft && !writing && (next < srcRows)) {
+    STAT_START(t);
+    tft->startWrite(); // Resume SPI
+    writing = true;
+    STAT_ADD(stats, transactions, 1);
+    // Other things may have been drawn since the last step, so the
+    // window is set again (bottom-up sets one per scanline anyway)
+    if (!bottomUp) {
+      int done = next >> scale; // Output rows already drawn
+      tft->setAddrWindow(x, y + done, loadWidth, loadHeight - done);
+    }
+    STAT_SINCE(stats, pushMicros, t);
+  }
+
+  int last = ((srcRows - next) < count) ? srcRows : (next + count);
+  for (; next < last; next++) { // For each scanline...
+    int i = next;
+#if defined(ESP32)
+    if (img && *stop) { // cancelPrefetch() during prefetchBMP()
+      status = IMAGE_ERR_CANCELED; // (partial image is freed by end())
+      srcRows = next; // No more scanlines
+      break;
+    }
+#endif
+    row = bottomUp ? (srcRows - 1 - i) : i;
+    outRow = row >> scale;
+    canvasRow = outRow % canvasRows;
+    // When downscaling, each output row comes from the first of
+    // its 2^scale scanlines (point sampling, others are skipped
+    // and never read), or from all of them (box averaging, which
+    // starts at the last when going bottom-up).
+    uint8_t sub = row & ((1 << scale) - 1), // Scanline in output row
+        subEnd = (1 << scale) - 1;
+    boolean boxFirst = !sub,                // First of output row
+        boxLast = !avg || (sub == subEnd);  // Last of same
+    if (avg && bottomUp) {
+      boxFirst = (sub == subEnd);
+      boxLast = !sub;
+    }
+    if (!boxFirst && !avg) {
+      if (rle) // Compressed data can't be skipped, must still decode
+        rleRow(rleState, NULL, 0, 0);
+      else if (qoi)
+        qoiRow(rleState, qoiState, NULL, 0, 0);
+      continue;
     }
 
-    if ((planes == 1) && (compression == 0)) { // Only uncompressed is handled
+    yield(); // Keep ESP8266 happy
 
-      // BMP rows are padded (if needed) to 4-byte boundary
-      rowSize = ((depth * bmpWidth + 31) / 32) * 4;
+    // File position of start of (clipped) scan line. It might
+    // seem labor-intensive to be doing this on every line, but
+    // this method covers a lot of gritty details like cropping,
+    // flip and scanline padding. Also, the read (and seek, if
+    // needed) only takes place if the scanline isn't already in
+    // sdbuf (avoids a lot of cluster math in SD library).
+    if (flip) // Bitmap is stored bottom-to-top order (normal BMP)
+      bmpPos = offset + (bmpHeight - 1 - (row + loadY)) * rowSize;
+    else // Bitmap is stored top-to-bottom
+      bmpPos = offset + (row + loadY) * rowSize;
+    bmpPos += rowFirst;
+    if (img && (depth == 1)) { // Each canvas1 row starts on a byte
+      bitOut = 0x80;
+      destidx = ((loadWidth + 7) / 8) * canvasRow;
+    }
+    if (img && direct) { // 565 data is read straight into canvas
+      STAT_START(t);
+      if (in.position() != bmpPos) {
+        in.seek(bmpPos);
+        STAT_ADD(stats, seeks, 1);
+      }
+      in.read((uint8_t *)&dest[canvasRow * loadWidth], loadWidth * 2);
+      STAT_SINCE(stats, readMicros, t);
+      STAT_ADD(stats, reads, 1);
+      STAT_ADD(stats, bytesRead, loadWidth * 2);
+      continue;
+    }
+    if (rle) { // Decode next scanline (cropped) from RLE stream
+      rleRow(rleState, line, loadX, spanWidth);
+      src = line;
+    } else if (qoi) { // Same, from QOI stream
+      qoiRow(rleState, qoiState, line, loadX, spanWidth);
+      src = line;
+    } else
+#if defined(ESP32)
+        if (ring) { // Scanline is read by the pipeline task
+      xQueueReceive(pipe.full, &src, portMAX_DELAY);
+    } else
+#endif
+        if ((bmpPos >= bufPos) &&
+            ((bmpPos + rowBytes) <= (bufPos + srclen))) {
+      src = &sdbuf[bmpPos - bufPos]; // Already in sdbuf
+    } else {                         // Time to load more
+      // Next workRows scanlines in the order processed, or
+      // fewer if near the end (or just one if point sampling).
+      // When flipped (and processed top-down), these precede
+      // the current scanline in the file.
+      uint32_t n = (scale && !avg) ? 1 : (srcRows - i);
+      if (n > workRows)
+        n = workRows;
+      bufPos = (flip && !bottomUp) ? (bmpPos - (n - 1) * rowSize) : bmpPos;
+      srclen = (n - 1) * rowSize + rowBytes;
+      if (tft && (transact || direct))
+        tft->dmaWait(); // Finish any DMA in progress (565 is from sdbuf)
+      if (tft && transact)
+        tft->endWrite(); // End TFT SPI transact
+      STAT_START(t);
+      if (in.position() != bufPos) { // Seek = SD transaction
+        in.seek(bufPos);
+        STAT_ADD(stats, seeks, 1);
+      }
+      in.read(sdbuf, srclen); // Load from SD
+      STAT_SINCE(stats, readMicros, t);
+      STAT_ADD(stats, reads, 1);
+      STAT_ADD(stats, bytesRead, srclen);
+      if (tft && transact) {
+        tft->startWrite(); // Start TFT SPI transact
+        STAT_ADD(stats, transactions, 1);
+      }
+      src = &sdbuf[bmpPos - bufPos];
+    }
 
-      if ((depth == 24) || (depth == 1)) { // BGR or 1-bit bitmap format
+    if (toRows) // Drawing to TFT or sink? Each scanline starts at dest[0]
+      destidx = 0;
+    else if (depth > 1) // Position in canvas (1-bit: above)
+      destidx = canvasRow * loadWidth;
 
-        if (img) {
-          // Loading to RAM -- allocate GFX 16-bit canvas type
-          status = IMAGE_ERR_MALLOC; // Assume won't fit to start
-          if (depth == 24) {
-            if ((img->canvas.canvas16 = new GFXcanvas16(bmpWidth, bmpHeight))) {
-              dest = img->canvas.canvas16->getBuffer();
+    STAT_START(tConvert);
+    if (scale) { // Downscaling
+      uint32_t bitPos = (loadX * depth) & 7; // First pixel, if <8-bit
+      for (col = 0; col < loadWidth; col++) { // For each output pixel...
+        uint32_t c = col << scale; // First source pixel in span
+        if (avg) {
+          // Add source pixels into output pixel's sums, output
+          // the average after the last scanline of the square
+          uint16_t *sum = &sums[col * 3];
+          if (boxFirst)
+            sum[0] = sum[1] = sum[2] = 0;
+          for (uint8_t j = 0; j < (1 << scale); j++, c++) {
+            if (depth == 24) {
+              b = src[c * 3];
+              g = src[c * 3 + 1];
+              r = src[c * 3 + 2];
+            } else if (depth == 32) {
+              b = src[c * 4];
+              g = src[c * 4 + 1];
+              r = src[c * 4 + 2];
+            } else {
+              uint16_t p = src[c * 2] | (src[c * 2 + 1] << 8);
+              r = maskTo8(p, bmp.maskShift[0], bmp.maskBits[0]);
+              g = maskTo8(p, bmp.maskShift[1], bmp.maskBits[1]);
+              b = maskTo8(p, bmp.maskShift[2], bmp.maskBits[2]);
             }
+            sum[0] += r;
+            sum[1] += g;
+            sum[2] += b;
+          }
+          if (!boxLast)
+            continue;
+          r = sum[0] >> (scale * 2);
+          g = sum[1] >> (scale * 2);
+          b = sum[2] >> (scale * 2);
+        } else if (depth == 24) { // Point sampling from here down
+          b = src[c * 3];
+          g = src[c * 3 + 1];
+          r = src[c * 3 + 2];
+        } else if (depth == 32) {
+          b = src[c * 4];
+          g = src[c * 4 + 1];
+          r = src[c * 4 + 2];
+        } else if (depth == 16) {
+          uint16_t p = src[c * 2] | (src[c * 2 + 1] << 8);
+          r = maskTo8(p, bmp.maskShift[0], bmp.maskBits[0]);
+          g = maskTo8(p, bmp.maskShift[1], bmp.maskBits[1]);
+          b = maskTo8(p, bmp.maskShift[2], bmp.maskBits[2]);
+        } else {
+          // Extract 8-, 4- or 1-bit color index, store as below
+          uint8_t n;
+          if (srcDepth == 8) {
+            n = src[c];
+          } else {
+            uint32_t pos = bitPos + c * depth;
+            n = (src[pos >> 3] >> (8 - depth - (pos & 7))) & bitMask;
+          }
+          if (toRows) {
+            dest[destidx++] = quantized[n];
+          } else if (depth > 1) {
+            dest8[destidx++] = n;
           } else {
-            if ((img->canvas.canvas1 = new GFXcanvas1(bmpWidth, bmpHeight))) {
-              dest1 = img->canvas.canvas1->getBuffer();
+            if (n)
+              dest1[destidx] |= bitOut;
+            else
+              dest1[destidx] &= ~bitOut;
+            bitOut >>= 1;
+            if (!bitOut) {
+              bitOut = 0x80;
+              destidx++;
             }
           }
-          // Future: handle other depths.
+          continue;
         }
+        dest[destidx++] = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+      } // end pixel loop
+    } else if (!direct) { // Decode scanline (565 data needs none)
+      decode(src,
+             toRows ? (uint8_t *)dest : &canvasBuf[canvasRow * canvasStride],
+             loadWidth, decodeArgs);
+    }
+    if (maskBuf && !sub) // Alpha to mask (if downscaling, from
+      alphaBits(src, &maskBuf[canvasRow * maskStride], // first pixel
+                loadWidth, 4 << scale); // of each square)
+    STAT_SINCE(stats, convertMicros, tConvert);
+    if (tft && boxLast) { // Drawing to TFT? (and row is complete)
+      STAT_START(tPush);
+      // Non-blocking (DMA) write of scanline, then switch to
+      // the other 'dest' buffer so the next one can be
+      // converted while this one is going out. The buffer
+      // being switched to was issued before this one, and
+      // SPITFT won't start a DMA transfer until the prior one
+      // is done, so no dmaWait() is needed here; only before
+      // each endWrite().
+      // RLE (and forward-only bottom-to-top) scanlines are
+      // written bottom-up, each needing its own address
+      // window, which can't be set until the previous
+      // scanline's DMA transfer is done.
+      // 565 data is written from the read buffer as-is
+      // (SPITFT handles the byte order).
+      if (bottomUp) {
+        tft->dmaWait();
+        tft->setAddrWindow(x, y + outRow, loadWidth, 1);
+      }
+      if (direct) {
+        tft->writePixels((uint16_t *)src, loadWidth, false);
+      } else {
+        // Write it (24- & 32-bit is already big-endian), swap buffers
+        tft->writePixels(dest, loadWidth, false, (depth >= 24) && !scale);
+        uint16_t *t = dest;
+        dest = destNext;
+        destNext = t;
+      }
+      STAT_SINCE(stats, pushMicros, tPush);
+    } else if (sink && boxLast) { // Sink gets pointer to same buffer
+      STAT_START(tPush);
+      sink->row(x, y + outRow, direct ? (uint16_t *)src : dest, loadWidth,
+                sinkFormat);
+      STAT_SINCE(stats, pushMicros, tPush);
+    }
+#if defined(ESP32)
+    if (ring) { // Return scanline buffer to reader task
+      if (direct)
+        tft->dmaWait(); // 565 scanline may still be going out
+      xQueueSend(pipe.empty, &src, portMAX_DELAY);
+    }
+#endif
+  } // end scanline loop
+}
 
-        if (dest || dest1) { // Supported format, alloc OK, etc.
-          status = IMAGE_SUCCESS;
-
-          if ((loadWidth > 0) && (loadHeight > 0)) { // Clip top/left
-            if (tft) {
-              tft->startWrite(); // Start SPI (regardless of transact)
-              tft->setAddrWindow(x, y, loadWidth, loadHeight);
-            } else {
-              if (depth == 1) {
-                img->format = IMAGE_1; // Is a GFX 1-bit canvas type
-              } else {
-                img->format = IMAGE_16; // Is a GFX 16-bit canvas type
-              }
-            }
+/*!
+    @brief   Let any DMA transfer finish and end the TFT write, so other
+             devices on the bus (or other code) can be used until the next
+             rows() call, which sets the TFT's address window again, so
+             other things can be drawn to that display meanwhile.
+    @return  None (void).
+*/
+void BMPCore::pause(void) {
+  if (writing) {
+    STAT_TIME(stats, pushMicros,
+              tft->dmaWait()); // Let last DMA transfer finish, then
+    tft->endWrite();           // end TFT (regardless of transact)
+    writing = false;
+  }
+}
 
-            if ((depth >= 16) ||
-                (quantized = (uint16_t *)malloc(colors * sizeof(uint16_t)))) {
-              if (depth < 16) {
-                // Load and quantize color table
-                for (uint16_t c = 0; c < colors; c++) {
-                  b = file.read();
-                  g = file.read();
-                  r = file.read();
-                  (void)file.read(); // Ignore 4th byte
-                  quantized[c] =
-                      ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
-                }
-              }
-
-              for (row = 0; row < loadHeight; row++) { // For each scanline...
-
-                yield(); // Keep ESP8266 happy
-
-                // Seek to start of scan line.  It might seem labor-intensive
-                // to be doing this on every line, but this method covers a
-                // lot of gritty details like cropping, flip and scanline
-                // padding. Also, the seek only takes place if the file
-                // position actually needs to change (avoids a lot of cluster
-                // math in SD library).
-                if (flip) // Bitmap is stored bottom-to-top order (normal BMP)
-                  bmpPos = offset + (bmpHeight - 1 - (row + loadY)) * rowSize;
-                else // Bitmap is stored top-to-bottom
-                  bmpPos = offset + (row + loadY) * rowSize;
-                if (depth == 24) {
-                  bmpPos += loadX * 3;
-                } else {
-                  bmpPos += loadX / 8;
-                  bitIn = 7 - (loadX & 7);
-                  bitOut = 0x80;
-                  if (img)
-                    destidx = ((bmpWidth + 7) / 8) * row;
-                }
-                if (file.position() != bmpPos) { // Need seek?
-                  if (transact) {
-                    tft->dmaWait();
-                    tft->endWrite(); // End TFT SPI transaction
-                  }
-                  file.seek(bmpPos);     // Seek = SD transaction
-                  srcidx = sizeof sdbuf; // Force buffer reload
-                }
-                for (col = 0; col < loadWidth; col++) { // For each pixel...
-                  if (srcidx >= sizeof sdbuf) {         // Time to load more?
-                    if (tft) {                          // Drawing to TFT?
-                      if (transact) {
-                        tft->dmaWait();
-                        tft->endWrite(); // End TFT SPI transact
-                      }
-#if defined(ARDUINO_NRF52_ADAFRUIT)
-                      // NRF52840 seems to have trouble reading more than 512
-                      // bytes across certain boundaries. Workaround for now
-                      // is to break the read into smaller chunks...
-                      int32_t bytesToGo = sizeof sdbuf, bytesRead = 0,
-                              bytesThisPass;
-                      while (bytesToGo > 0) {
-                        bytesThisPass = min(bytesToGo, 512);
-                        file.read(&sdbuf[bytesRead], bytesThisPass);
-                        bytesRead += bytesThisPass;
-                        bytesToGo -= bytesThisPass;
-                      }
-#else
-                      file.read(sdbuf, sizeof sdbuf); // Load from SD
+/*!
+    @brief   Finish a BMP draw or load, whether or not all scanlines were
+             processed: end TFT write or sink, stop reader task, release
+             working buffers, free the image if it's incomplete and
+             close a re-opened file.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode BMPCore::end(void) {
+  pause();
+  if (sink && work)
+    sink->end();
+#if defined(ESP32)
+  if (ring) { // Wait for reader task to finish, clean up
+    xSemaphoreTake(pipe.done, portMAX_DELAY);
+    vQueueDelete(pipe.empty);
+    vQueueDelete(pipe.full);
+    vSemaphoreDelete(pipe.done);
+    allocator->release(ring, IMAGE_MEM_WORK);
+    ring = NULL;
+  }
 #endif
-                      if (transact)
-                        tft->startWrite(); // Start TFT SPI transact
-                      if (destidx) {       // If buffered TFT data
-                        // Non-blocking writes (DMA) have been temporarily
-                        // disabled until this can be rewritten with two
-                        // alternating 'dest' buffers (else the nonblocking
-                        // data out is overwritten in the dest[] write below).
-                        // tft->writePixels(dest, destidx, false); // Write it
-                        tft->writePixels(dest, destidx, true); // Write it
-                        destidx = 0; // and reset dest index
-                      }
-                    } else {                          // Canvas is simpler,
-                      file.read(sdbuf, sizeof sdbuf); // just load sdbuf
-                    }                                 // (destidx never resets)
-                    srcidx = 0;                       // Reset bmp buf index
-                  }
-                  if (depth == 24) {
-                    // Convert each pixel from BMP to 565 format, save in dest
-                    b = sdbuf[srcidx++];
-                    g = sdbuf[srcidx++];
-                    r = sdbuf[srcidx++];
-                    dest[destidx++] =
-                        ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
-                  } else {
-                    // Extract 1-bit color index
-                    uint8_t n = (sdbuf[srcidx] >> bitIn) & 1;
-                    if (!bitIn) {
-                      srcidx++;
-                      bitIn = 7;
-                    } else {
-                      bitIn--;
-                    }
-                    if (tft) {
-                      // Look up in palette, store in tft dest buf
-                      dest[destidx++] = quantized[n];
-                    } else {
-                      // Store bit in canvas1 buffer (ignore palette)
-                      if (n)
-                        dest1[destidx] |= bitOut;
-                      else
-                        dest1[destidx] &= ~bitOut;
-                      bitOut >>= 1;
-                      if (!bitOut) {
-                        bitOut = 0x80;
-                        destidx++;
-                      }
-                    }
-                  }
-                }                // end pixel loop
-                if (tft) {       // Drawing to TFT?
-                  if (destidx) { // Any remainders?
-                    // See notes above re: DMA
-                    // tft->writePixels(dest, destidx, false); // Write it
-                    tft->writePixels(dest, destidx, true); // Write it
-                    destidx = 0; // and reset dest index
-                  }
-                  tft->dmaWait();
-                  tft->endWrite(); // End TFT (regardless of transact)
-                }
-              } // end scanline loop
-
-              if (quantized) {
-                if (tft)
-                  free(quantized); // Palette no longer needed
-                else
-                  img->palette = quantized; // Keep palette with img
-              }
-            } // end depth>24 or quantized malloc OK
-          }   // end top/left clip
-        }     // end malloc check
-      }       // end depth check
-    }         // end planes/compression check
-  }           // end signature
+  if (workAlloc)
+    allocator->release(workAlloc, IMAGE_MEM_WORK);
+  work = workAlloc = NULL;
+  if (img && (status != IMAGE_SUCCESS))
+    img->dealloc(); // Don't leave a partial image
+  if (reopened) // Handle doesn't keep file open, close it again
+    bmp.file.close();
+  reopened = false;
+  return status;
+}
 
-  file.close();
+/*!
+    @brief   BMP-reading function common both to the draw function (to TFT)
+             and load function (to canvas object in RAM). BMP code has been
+             centralized here (and in BMPCore) so if/when more BMP format
+             variants are added in the future, it doesn't need to be
+             implemented, debugged and kept in sync in two places.
+    @param   bmp
+             Adafruit_BMPInfo handle from openBMP(), with header parsed.
+    @param   tft
+             Pointer to TFT object, if loading to screen, else NULL.
+    @param   x
+             Horizontal offset in pixels (if loading to screen).
+    @param   y
+             Vertical offset in pixels (if loading to screen).
+    @param   srcX
+             Left edge of rectangle within BMP image to draw or load.
+    @param   srcY
+             Top edge of rectangle within BMP image to draw or load.
+    @param   srcW
+             Width of rectangle within BMP image to draw or load.
+    @param   srcH
+             Height of rectangle within BMP image to draw or load.
+    @param   img
+             Pointer to Adafruit_Image object, if loading to RAM (or NULL
+             if loading to screen).
+    @param   transact
+             Use SPI transactions; 'true' is needed only if loading to screen
+             and it's on the same SPI bus as the SD card. Other situations
+             can use 'false'.
+    @param   sink
+             Pointer to Adafruit_ImageSink object, if drawing to one (tft
+             and img are then NULL), else NULL.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure).
+*/
+ImageReturnCode Adafruit_ImageReader::coreBMP(
+    Adafruit_BMPInfo &bmp, Adafruit_SPITFT *tft, int16_t x, int16_t y,
+    int16_t srcX, int16_t srcY, int16_t srcW, int16_t srcH,
+    Adafruit_Image *img, boolean transact, Adafruit_ImageSink *sink) {
+  BMPCore core(bmp, stats);
+  if (core.begin(*this, tft, x, y, srcX, srcY, srcW, srcH, img, transact,
+                 sink) == IMAGE_SUCCESS)
+    core.rows(core.srcRows);
+  return core.end();
+}
+
+/*!
+    @brief   Set up a BMP draw or load in steps (or bands), see BMPCore. The
+             decoding state is allocated with the reader's allocator, and
+             kept until endBMP().
+    @param   core
+             Pointer set to the new BMPCore, or NULL if it couldn't be
+             allocated (or there's nothing to do).
+    @param   bmp
+             Adafruit_BMPInfo handle from openBMP(), kept valid until
+             endBMP().
+    @param   tft
+             Pointer to TFT object, if drawing to screen, else NULL.
+    @param   x
+             Horizontal offset in pixels (if drawing to screen).
+    @param   y
+             Vertical offset in pixels (if drawing to screen).
+    @param   srcX
+             Left edge of rectangle within BMP image to draw or load.
+    @param   srcY
+             Top edge of rectangle within BMP image to draw or load.
+    @param   srcW
+             Width of rectangle within BMP image to draw or load.
+    @param   srcH
+             Height of rectangle within BMP image to draw or load.
+    @param   img
+             Pointer to Adafruit_Image object, if loading (a band of rows
+             at a time) to RAM, else NULL.
+    @param   band
+             If loading, number of output rows (canvas height) per band.
+    @param   transact
+             Use SPI transactions, as coreBMP().
+    @param   rows
+             Set to number of output rows to draw or load (as clipped to
+             screen); 0 if none or on failure. Optional.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS if stepBMP()
+             can proceed, or if there's nothing to draw; other values on
+             failure, and core is then NULL).
+*/
+ImageReturnCode Adafruit_ImageReader::beginBMP(
+    BMPCore *&core, Adafruit_BMPInfo &bmp, Adafruit_SPITFT *tft, int16_t x,
+    int16_t y, int16_t srcX, int16_t srcY, int16_t srcW, int16_t srcH,
+    Adafruit_Image *img, int16_t band, boolean transact, int16_t *rows) {
+  ImageReturnCode status = IMAGE_ERR_MALLOC;
+  void *mem = allocator->alloc(sizeof(BMPCore), IMAGE_MEM_WORK);
+  core = mem ? new (mem) BMPCore(bmp, stats) : NULL;
+  if (rows)
+    *rows = 0;
+  if (core) {
+    core->band = band;
+    core->stepped = (tft != NULL); // ePaper bands run within one call
+    status = core->begin(*this, tft, x, y, srcX, srcY, srcW, srcH, img,
+                         transact, NULL);
+    core->pause(); // TFT is only written during steps
+    if (status != IMAGE_SUCCESS)
+      endBMP(core);
+    else if (rows)
+      *rows = core->srcRows >> core->scale;
+  }
+  return status;
+}
+
+/*!
+    @brief   Next output rows of a BMP draw or load begun with beginBMP(),
+             bottom-up for RLE images. If loading in bands, stops at the
+             end of a band, so that band is then complete in the canvas.
+    @param   core
+             BMPCore from beginBMP().
+    @param   n
+             Maximum number of output rows.
+    @param   top
+             Set to first output row processed (relative to top of the
+             clipped image); these and the rows below it are in the band
+             canvas starting at its row (top % band). Optional.
+    @param   count
+             Set to number of rows processed (0 when done). Optional.
+    @return  One of the ImageReturnCode values, IMAGE_SUCCESS if rows were
+             processed or there are none left.
+*/
+ImageReturnCode Adafruit_ImageReader::stepBMP(BMPCore *core, int16_t n,
+                                              int16_t *top, int16_t *count) {
+  int h = core->srcRows >> core->scale,     // Output rows in all
+      done = core->next >> core->scale,     // and so far
+      band = core->canvasRows, first, rows; // Band boundaries
+  if (done >= h) { // Finished, or nothing to draw
+    first = done;
+    rows = 0;
+  } else if (core->bottomUp) { // Bottom band first, which may be short
+    int left = h - done;
+    first = ((left - 1) / band) * band;
+    if ((left - first) > n)
+      first = left - n;
+    rows = left - first;
+  } else {
+    first = done;
+    rows = band - (done % band);
+    if (rows > (h - done))
+      rows = h - done;
+    if (rows > n)
+      rows = n;
+  }
+  core->rows(rows << core->scale);
+  if (core->stepped)
+    core->pause();
+  if (top)
+    *top = first;
+  if (count)
+    *count = rows;
+  return core->status;
+}
+
+/*!
+    @brief   Finish a BMP draw or load begun with beginBMP() (whether or
+             not all rows were processed) and free its decoding state.
+    @param   core
+             BMPCore from beginBMP(), set to NULL. Can already be NULL.
+    @return  One of the ImageReturnCode values, the draw or load's result.
+*/
+ImageReturnCode Adafruit_ImageReader::endBMP(BMPCore *&core) {
+  ImageReturnCode status = IMAGE_SUCCESS;
+  if (core) {
+    status = core->end();
+    core->~BMPCore();
+    allocator->release(core, IMAGE_MEM_WORK);
+    core = NULL;
+  }
   return status;
 }
 
 /*!
-    @brief   Query pixel dimensions of BMP image file on SD card.
+    @brief   Query pixel dimensions of BMP (or QOI) image file on SD card.
     @param   filename
              Name of BMP image file to query.
     @param   width
@@ -610,69 +3854,76 @@ ImageReturnCode Adafruit_ImageReader::bmpDimensions(char *filename,
                                                     int32_t *height) {
 
   ImageReturnCode status = IMAGE_ERR_FILE_NOT_FOUND; // Guilty until innocent
+  File file;
+  Adafruit_ImageFile in(file);
 
   if ((file = filesys->open(filename, FILE_READ))) { // Open requested file
-    status = IMAGE_ERR_FORMAT;  // File's there, might not be BMP tho
-    if (readLE16() == 0x4D42) { // BMP signature?
-      (void)readLE32();         // Read & ignore file size
-      (void)readLE32();         // Read & ignore creator bytes
-      (void)readLE32();         // Read & ignore position of image data
-      (void)readLE32();         // Read & ignore header size
+    status = IMAGE_ERR_FORMAT;      // File's there, might not be BMP tho
+    uint16_t signature = readLE16(in);
+    uint8_t hdr[10];
+    if ((signature == 0x6F71) && // QOI signature? (big-endian size)
+        (in.read(hdr, sizeof hdr) == sizeof hdr) && (hdr[0] == 'i') &&
+        (hdr[1] == 'f')) {
+      if (width)
+        *width = ((uint32_t)hdr[2] << 24) | ((uint32_t)hdr[3] << 16) |
+                 (hdr[4] << 8) | hdr[5];
+      if (height)
+        *height = ((uint32_t)hdr[6] << 24) | ((uint32_t)hdr[7] << 16) |
+                  (hdr[8] << 8) | hdr[9];
+      status = IMAGE_SUCCESS;
+    } else if (signature == 0x4D42) { // BMP signature?
+      (void)readLE32(in);         // Read & ignore file size
+      (void)readLE32(in);         // Read & ignore creator bytes
+      (void)readLE32(in);         // Read & ignore position of image data
+      (void)readLE32(in);         // Read & ignore header size
       if (width)
-        *width = readLE32();
+        *width = readLE32(in);
       if (height) {
-        int32_t h = readLE32(); // Don't abs() this, may be a macro
+        int32_t h = readLE32(in); // Don't abs() this, may be a macro
         if (h < 0)
           h = -h; // Do manually instead
         *height = h;
       }
       status = IMAGE_SUCCESS; // YAY.
     }
+    file.close();
   }
 
-  file.close();
   return status;
 }
 
 // UTILITY FUNCTIONS *******************************************************
 
 /*!
-    @brief   Reads a little-endian 16-bit unsigned value from currently-
-             open File, converting if necessary to the microcontroller's
+    @brief   Reads a little-endian 16-bit unsigned value from an image
+             source, converting if necessary to the microcontroller's
              native endianism. (BMP files use little-endian values.)
+    @param   src
+             Adafruit_ImageSource (e.g. open File) to read from.
     @return  Unsigned 16-bit value, native endianism.
 */
-uint16_t Adafruit_ImageReader::readLE16(void) {
-#if !defined(ESP32) && !defined(ESP8266) &&                                    \
-    (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
-  // Read directly into result -- BMP data and variable both little-endian.
-  uint16_t result;
-  file.read(&result, sizeof result);
-  return result;
-#else
-  // Big-endian or unknown. Byte-by-byte read will perform reversal if needed.
-  return file.read() | ((uint16_t)file.read() << 8);
-#endif
+uint16_t Adafruit_ImageReader::readLE16(Adafruit_ImageSource &src) {
+  // Read bytes into an array first; reassembling them from individual
+  // read() calls in a single expression would leave the order of
+  // the reads up to the compiler.
+  uint8_t b[2] = {0, 0};
+  src.read(b, sizeof b);
+  return b[0] | ((uint16_t)b[1] << 8);
 }
 
 /*!
-    @brief   Reads a little-endian 32-bit unsigned value from currently-
-             open File, converting if necessary to the microcontroller's
+    @brief   Reads a little-endian 32-bit unsigned value from an image
+             source, converting if necessary to the microcontroller's
              native endianism. (BMP files use little-endian values.)
+    @param   src
+             Adafruit_ImageSource (e.g. open File) to read from.
     @return  Unsigned 32-bit value, native endianism.
 */
-uint32_t Adafruit_ImageReader::readLE32(void) {
-#if !defined(ESP32) && !defined(ESP8266) &&                                    \
-    (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
-  // Read directly into result -- BMP data and variable both little-endian.
-  uint32_t result;
-  file.read(&result, sizeof result);
-  return result;
-#else
-  // Big-endian or unknown. Byte-by-byte read will perform reversal if needed.
-  return file.read() | ((uint32_t)file.read() << 8) |
-         ((uint32_t)file.read() << 16) | ((uint32_t)file.read() << 24);
-#endif
+uint32_t Adafruit_ImageReader::readLE32(Adafruit_ImageSource &src) {
+  uint8_t b[4] = {0, 0, 0, 0};
+  src.read(b, sizeof b);
+  return b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) |
+         ((uint32_t)b[3] << 24);
 }
 
 /*!
@@ -693,4 +3944,261 @@ void Adafruit_ImageReader::printStatus(ImageReturnCode stat, Stream &stream) {
     stream.println(F("Not a supported BMP variant."));
   else if (stat == IMAGE_ERR_MALLOC)
     stream.println(F("Malloc failed (insufficient RAM)."));
+  else if (stat == IMAGE_ERR_CANCELED)
+    stream.println(F("Canceled."));
+}
+
+/*!
+    @brief   Print statistics for the most recent drawBMP() or loadBMP()
+             call (see getStats()) in human-readable form.
+    @param   stream
+             Output stream (Serial default if unspecified).
+    @return  None (void).
+*/
+void Adafruit_ImageReader::printStats(Stream &stream) {
+#if defined(IMAGEREADER_STATS)
+  stream.print(F("Open: "));
+  stream.print(stats.openMicros);
+  stream.print(F(" us, parse: "));
+  stream.print(stats.parseMicros);
+  stream.print(F(" us, read: "));
+  stream.print(stats.readMicros);
+  stream.print(F(" us, convert: "));
+  stream.print(stats.convertMicros);
+  stream.print(F(" us, push: "));
+  stream.print(stats.pushMicros);
+  stream.println(F(" us"));
+  stream.print(F("Read: "));
+  stream.print(stats.bytesRead);
+  stream.print(F(" bytes in "));
+  stream.print(stats.reads);
+  stream.print(F(" reads, "));
+  stream.print(stats.seeks);
+  stream.print(F(" seeks, "));
+  stream.print(stats.transactions);
+  stream.print(F(" transactions, "));
+  stream.print(stats.peakBuffer);
+  stream.println(F(" bytes buffer"));
+#else
+  stream.println(F("Stats not compiled in (define IMAGEREADER_STATS)."));
+#endif
+}
+
+// ADAFRUIT_IMAGECACHE CLASS ***********************************************
+// Keeps recently drawn images loaded in RAM, so images that are drawn
+// repeatedly (icons, backgrounds) are read and converted only once.
+
+/*!
+    @brief   Constructor.
+    @param   reader
+             Adafruit_ImageReader (and its filesystem) that images are
+             loaded from. Its settings at the time of loading (e.g.
+             setDownscale()) apply to the cached image.
+    @param   budget
+             Maximum RAM, in bytes, used by cached images' pixels and
+             palettes. Least recently used images are evicted to stay
+             within this. Images are allocated with the reader's
+             allocator, see its setAllocator() (e.g. to place them in
+             PSRAM).
+    @param   slots
+             Maximum number of images cached at once (default 8).
+    @return  Adafruit_ImageCache object.
+*/
+Adafruit_ImageCache::Adafruit_ImageCache(Adafruit_ImageReader &reader,
+                                         uint32_t budget, uint8_t slots)
+    : reader(&reader), budget(budget), used(0), tick(0) {
+  numSlots = (entries = new Entry[slots]) ? slots : 0;
+  resetStats();
+}
+
+/*!
+    @brief   Destructor. Frees all cached images.
+    @return  None (void).
+*/
+Adafruit_ImageCache::~Adafruit_ImageCache(void) {
+  clear();
+  delete[] entries;
+}
+
+/*!
+    @brief   Draw image from cache, loading it first if not present.
+    @param   filename
+             Name of BMP image file to draw.
+    @param   tft
+             Screen to draw to (any Adafruit_SPITFT-derived class).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure). An image too large for
+             the cache (or for available RAM) is drawn straight from the
+             file with the reader's drawBMP() instead.
+*/
+ImageReturnCode Adafruit_ImageCache::draw(const char *filename,
+                                          Adafruit_SPITFT &tft, int16_t x,
+                                          int16_t y) {
+  ImageReturnCode status;
+  Adafruit_Image *img = get(filename, &status);
+  if (img) {
+    img->draw(tft, x, y);
+  } else if (status == IMAGE_ERR_MALLOC) {
+    status = reader->drawBMP((char *)filename, tft, x, y);
+  }
+  return status;
+}
+
+/*!
+    @brief   Get image from cache, loading it first if not present.
+    @param   filename
+             Name of BMP image file.
+    @param   status
+             Optional pointer to ImageReturnCode, receives IMAGE_SUCCESS if
+             image was found or loaded, IMAGE_ERR_MALLOC if it doesn't fit
+             in the cache's budget or available RAM, other values if the
+             file could not be opened or loaded.
+    @return  Pointer to cached Adafruit_Image, or NULL on failure. Pointer
+             remains valid until the image is evicted, i.e. until the next
+             get(), draw(), remove(), setBudget() or clear() call.
+*/
+Adafruit_Image *Adafruit_ImageCache::get(const char *filename,
+                                         ImageReturnCode *status) {
+  Adafruit_BMPInfo bmp;
+  Entry *e = find(filename);
+  ImageReturnCode stat;
+
+  if (e) { // Cache hit
+    hitCount++;
+    e->lastUse = ++tick;
+    if (status)
+      *status = IMAGE_SUCCESS;
+    return &e->image;
+  }
+
+  missCount++;
+  if ((stat = reader->openBMP(filename, bmp)) == IMAGE_SUCCESS) {
+    // Evict images until there's room for this one at full size (an
+    // upper bound if cropped or downscaled; actual size is counted
+    // after loading), before allocating it.
+    uint32_t w = bmp.width(), h = bmp.height(), estimate;
+    uint8_t depth = bmp.getDepth();
+    if (depth >= 16) // 32-bit may have a mask, too
+      estimate = w * h * 2 + ((depth == 32) ? ((w + 7) / 8) * h : 0);
+    else if (depth == 1)
+      estimate = ((w + 7) / 8) * h + 2 * sizeof(uint16_t);
+    else
+      estimate = w * h + (1 << depth) * sizeof(uint16_t);
+    if (!numSlots || (estimate > budget)) {
+      stat = IMAGE_ERR_MALLOC; // Won't ever fit
+    } else {
+      while ((used + estimate) > budget)
+        evict(oldest());
+      if (!(e = find(NULL))) { // No free slot? Evict least recently used
+        e = oldest();
+        evict(e);
+      }
+      // If still not enough RAM (e.g. fragmented), evict more and retry
+      while (((stat = reader->loadBMP(bmp, e->image)) == IMAGE_ERR_MALLOC) &&
+             (used > 0))
+        evict(oldest());
+      if (stat == IMAGE_SUCCESS) {
+        if ((e->filename = (char *)malloc(strlen(filename) + 1))) {
+          strcpy(e->filename, filename);
+          e->bytes = e->image.size();
+          e->lastUse = ++tick;
+          used += e->bytes;
+        } else {
+          e->image.dealloc();
+          stat = IMAGE_ERR_MALLOC;
+        }
+      }
+    }
+  }
+
+  if (status)
+    *status = stat;
+  return (stat == IMAGE_SUCCESS) ? &e->image : NULL;
+}
+
+/*!
+    @brief   Remove an image from the cache, if present (e.g. if the file
+             has changed).
+    @param   filename
+             Name of BMP image file.
+    @return  None (void).
+*/
+void Adafruit_ImageCache::remove(const char *filename) {
+  Entry *e = find(filename);
+  if (e)
+    evict(e);
+}
+
+/*!
+    @brief   Remove all images from the cache. Counters are not reset
+             (see resetStats()).
+    @return  None (void).
+*/
+void Adafruit_ImageCache::clear(void) {
+  for (uint8_t i = 0; i < numSlots; i++)
+    if (entries[i].filename)
+      evict(&entries[i]);
+}
+
+/*!
+    @brief   Change cache's RAM budget, evicting least recently used
+             images as needed to stay within it.
+    @param   bytes
+             Maximum RAM, in bytes, used by cached images.
+    @return  None (void).
+*/
+void Adafruit_ImageCache::setBudget(uint32_t bytes) {
+  budget = bytes;
+  while (used > budget)
+    evict(oldest());
+}
+
+/*!
+    @brief   Reset hit, miss and eviction counters to 0.
+    @return  None (void).
+*/
+void Adafruit_ImageCache::resetStats(void) {
+  hitCount = 0;
+  missCount = 0;
+  evictCount = 0;
+}
+
+// Find cached image by filename, or a free slot if filename is NULL.
+Adafruit_ImageCache::Entry *Adafruit_ImageCache::find(const char *filename) {
+  for (uint8_t i = 0; i < numSlots; i++) {
+    if (filename ? (entries[i].filename &&
+                    !strcmp(entries[i].filename, filename))
+                 : !entries[i].filename)
+      return &entries[i];
+  }
+  return NULL;
+}
+
+// Find least recently used image, NULL if cache is empty.
+Adafruit_ImageCache::Entry *Adafruit_ImageCache::oldest(void) {
+  Entry *e = NULL;
+  for (uint8_t i = 0; i < numSlots; i++) {
+    if (entries[i].filename &&
+        (!e || ((int32_t)(entries[i].lastUse - e->lastUse) < 0)))
+      e = &entries[i];
+  }
+  return e;
+}
+
+// Free cached image and its slot.
+void Adafruit_ImageCache::evict(Entry *e) {
+  if (e && e->filename) {
+    e->image.dealloc();
+    free(e->filename);
+    e->filename = NULL;
+    used -= e->bytes;
+    e->bytes = 0;
+    evictCount++;
+  }
 }
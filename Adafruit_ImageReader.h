@@ -18,20 +18,349 @@
 #include "SPIFFS.h"
 #include "Adafruit_SPITFT.h"
 
+// Uncomment (or define in build flags) to have drawBMP() and loadBMP()
+// measure where their time goes, see Adafruit_ImageReader::getStats().
+// When not defined, no measuring code is compiled in at all.
+// #define IMAGEREADER_STATS
+
+class Adafruit_ImageReader;
+class Adafruit_Image;
+class Adafruit_EPD; // See Adafruit_ImageReader_EPD.h
+struct BMPCore;     // Decoding state, see Adafruit_ImageReader.cpp
+
 /** Status codes returned by drawBMP() and loadBMP() */
 enum ImageReturnCode {
   IMAGE_SUCCESS,            // Successful load (or image clipped off screen)
   IMAGE_ERR_FILE_NOT_FOUND, // Could not open file
   IMAGE_ERR_FORMAT,         // Not a supported image format
-  IMAGE_ERR_MALLOC          // Could not allocate image (loadBMP() only)
+  IMAGE_ERR_MALLOC,         // Could not allocate image (loadBMP() only)
+  IMAGE_ERR_CANCELED        // Stopped by cancelPrefetch() (prefetch only)
 };
 
 /** Image formats returned by loadBMP() */
 enum ImageFormat {
   IMAGE_NONE, // No image was loaded; IMAGE_ERR_* condition
-  IMAGE_1,    // GFXcanvas1 image (NOT YET SUPPORTED)
-  IMAGE_8,    // GFXcanvas8 image (NOT YET SUPPORTED)
-  IMAGE_16    // GFXcanvas16 image (SUPPORTED)
+  IMAGE_1,    // GFXcanvas1 image (1-bit BMPs)
+  IMAGE_8,    // GFXcanvas8 image (8- & 4-bit BMPs incl. RLE, palette indices)
+  IMAGE_16    // GFXcanvas16 image (32-, 24- & 16-bit BMPs, QOI)
+};
+
+/** Uses of memory requested from an Adafruit_ImageAllocator */
+enum ImageMemory {
+  IMAGE_MEM_PIXELS,  // loadBMP() canvas (object and pixels), kept with image
+  IMAGE_MEM_PALETTE, // loadBMP() color palette, kept with image
+  IMAGE_MEM_WORK     // Scanline & read buffers, freed before call returns
+};
+
+/** ePaper color reduction, see Adafruit_Image_EPD::draw() */
+enum ImageDither {
+  IMAGE_DITHER_NONE,     // Threshold each pixel to black, white or red
+  IMAGE_DITHER_ORDERED,  // 4x4 Bayer matrix, no working memory
+  IMAGE_DITHER_DIFFUSION // Floyd-Steinberg, one scanline of error terms
+};
+
+/** Image types in an Adafruit_ImagePack, see ImagePack.getFormat() */
+enum ImagePackFormat {
+  IMAGE_PACK_OTHER, // Not an image type known to the reader
+  IMAGE_PACK_BMP,   // BMP (or QOI) image, for drawBMP() or loadBMP()
+  IMAGE_PACK_RAW    // Panel-native raw image, for drawRAW()
+};
+
+/** Pixel formats of scanlines passed to an Adafruit_ImageSink */
+enum ImageSinkFormat {
+  IMAGE_SINK_565,     // 16-bit 5/6/5 color, native byte order
+  IMAGE_SINK_565_SWAP // Same, byte-swapped (only 565 BMPs, big-endian MCU)
+};
+
+/** Function called when ImageReader.prefetchBMP() finishes, with its
+    result, image and 'arg' pointer (runs on the prefetch task) */
+typedef void (*Adafruit_PrefetchCallback)(ImageReturnCode status,
+                                          Adafruit_Image &img, void *arg);
+
+/*!
+   @brief  Where the time went in the most recent drawBMP(), loadBMP() or
+           openBMP() call (or incremental draw since beginDraw()), from
+           ImageReader.getStats(). All zero unless the library is compiled
+           with IMAGEREADER_STATS defined. Times are in microseconds.
+           Pipelined reads (see setPipeline()) are counted but not timed,
+           as they run on the other core.
+*/
+struct Adafruit_ImageStats {
+  uint32_t openMicros;    ///< Opening file (given a filename)
+  uint32_t parseMicros;   ///< Reading & parsing BMP header (same)
+  uint32_t readMicros;    ///< Reading & seeking image data
+  uint32_t convertMicros; ///< Converting pixels for display or canvas
+  uint32_t pushMicros;    ///< Writing to display, incl. dmaWait()
+  uint32_t bytesRead;     ///< Image data bytes read
+  uint32_t reads;         ///< Image data read() calls
+  uint32_t seeks;         ///< Image data seek() calls
+  uint32_t transactions;  ///< Display startWrite() calls
+  uint32_t peakBuffer;    ///< Largest working buffer use, in bytes
+};
+
+/*!
+   @brief  Memory allocation policy for Adafruit_ImageReader and the images
+           it loads. The base class uses malloc() and free(); subclass it
+           and override alloc() and release() to place memory elsewhere
+           (e.g. a fixed arena in a build without heap), then pass it to
+           ImageReader.setAllocator(). Working buffers (IMAGE_MEM_WORK)
+           may be issued to the display by DMA.
+*/
+class Adafruit_ImageAllocator {
+public:
+  virtual ~Adafruit_ImageAllocator(void) {}
+  virtual void *alloc(size_t bytes, ImageMemory use);
+  virtual void release(void *ptr, ImageMemory use);
+};
+
+#if defined(ESP32)
+/*!
+   @brief  Adafruit_ImageAllocator placing loaded canvases and palettes in
+           PSRAM, and working buffers in DMA-capable internal RAM, so large
+           images don't use up internal RAM needed by Wi-Fi and others.
+*/
+class Adafruit_ImageAllocatorPSRAM : public Adafruit_ImageAllocator {
+public:
+  void *alloc(size_t bytes, ImageMemory use);
+  void release(void *ptr, ImageMemory use);
+};
+#endif
+
+/*!
+   @brief  Where BMP data is read from, if not a file opened by name. Pass
+           one of the subclasses below (or your own) to ImageReader.openBMP(),
+           drawBMP() or loadBMP(). Sources that can't seek backward (see
+           seekable()) are read strictly front to back, which works for any
+           BMP drawn or loaded once.
+*/
+class Adafruit_ImageSource {
+public:
+  virtual ~Adafruit_ImageSource(void) {}
+  /*!
+      @brief   Read bytes from the current position.
+      @param   buf  Destination.
+      @param   len  Number of bytes requested.
+      @return  Number of bytes read, less than len at end of data.
+  */
+  virtual int read(uint8_t *buf, uint32_t len) = 0;
+  /*!
+      @brief   Move to a position.
+      @param   pos  Byte offset from start of image data.
+      @return  true on success, false if out of range (or backward and
+               not seekable()).
+  */
+  virtual boolean seek(uint32_t pos) = 0;
+  /*!
+      @brief   Return current position.
+      @return  Byte offset from start of image data.
+  */
+  virtual uint32_t position(void) = 0;
+  /*!
+      @brief   Check if source can seek backward.
+      @return  true (default) if any position can be seeked to, false if
+               only forward (by skipping data).
+  */
+  virtual boolean seekable(void) { return true; }
+};
+
+/*!
+   @brief  Adafruit_ImageSource reading from an already-open File (e.g.
+           from a filesystem other than the reader's). The File must stay
+           open while in use.
+*/
+class Adafruit_ImageFile : public Adafruit_ImageSource {
+public:
+  /*!
+      @brief   Constructor.
+      @param   file  Open File to read from.
+  */
+  Adafruit_ImageFile(File &file) : file(file) {}
+  int read(uint8_t *buf, uint32_t len);
+  boolean seek(uint32_t pos);
+  uint32_t position(void);
+
+private:
+  File &file; ///< File being read
+};
+
+/*!
+   @brief  Adafruit_ImageSource reading from memory, e.g. a const array
+           compiled into firmware (on ESP32 this is read in place from
+           flash) or a download kept in RAM. Skips the filesystem entirely.
+*/
+class Adafruit_ImageMemory : public Adafruit_ImageSource {
+public:
+  /*!
+      @brief   Constructor.
+      @param   data  Start of image (e.g. BMP file contents). Must stay
+                     valid while in use.
+      @param   len   Size of image data in bytes.
+  */
+  Adafruit_ImageMemory(const uint8_t *data, uint32_t len)
+      : data(data), len(len), pos(0) {}
+  int read(uint8_t *buf, uint32_t len);
+  boolean seek(uint32_t pos);
+  uint32_t position(void) { return pos; }
+
+private:
+  const uint8_t *data; ///< Image data
+  uint32_t len;        ///< Size of same
+  uint32_t pos;        ///< Current position
+};
+
+/*!
+   @brief  Adafruit_ImageSource reading front to back from a Stream (e.g.
+           an HTTP response body from a WiFiClient), so images can be shown
+           as they arrive without storing them in flash first. Seeking
+           forward discards data; seeking backward fails, so each BMP can
+           be drawn or loaded once. Reads wait up to the Stream's timeout
+           (see Stream::setTimeout()) for data to arrive.
+*/
+class Adafruit_ImageStream : public Adafruit_ImageSource {
+public:
+  /*!
+      @brief   Constructor.
+      @param   stream  Stream positioned at the start of the image.
+  */
+  Adafruit_ImageStream(Stream &stream) : stream(stream), pos(0) {}
+  int read(uint8_t *buf, uint32_t len);
+  boolean seek(uint32_t pos);
+  uint32_t position(void) { return pos; }
+  boolean seekable(void) { return false; }
+
+private:
+  Stream &stream; ///< Stream being read
+  uint32_t pos;   ///< Bytes consumed so far
+};
+
+/*!
+   @brief  Destination for drawBMP() other than an Adafruit_SPITFT display:
+           receives the image one decoded scanline at a time, e.g. into an
+           LVGL draw buffer, a framebuffer in PSRAM, a network encoder or
+           a non-SPITFT display. Only one scanline (plus the reader's
+           usual working buffer) is in RAM at a time, however large the
+           image. Subclass and implement row(); width() and height() give
+           the area scanlines are clipped to.
+*/
+class Adafruit_ImageSink {
+public:
+  virtual ~Adafruit_ImageSink(void) {}
+  /*!
+      @brief   Return width of area that drawn images are clipped to.
+      @return  Width in pixels (default, no clipping).
+  */
+  virtual int16_t width(void) { return 0x7FFF; }
+  /*!
+      @brief   Return height of area that drawn images are clipped to.
+      @return  Height in pixels (default, no clipping).
+  */
+  virtual int16_t height(void) { return 0x7FFF; }
+  /*!
+      @brief   Called once before the first row() of an image.
+      @param   x  Left edge of image, as clipped.
+      @param   y  Top edge of same.
+      @param   w  Width of same.
+      @param   h  Height of same.
+      @return  None (void).
+  */
+  virtual void begin(int16_t x, int16_t y, int16_t w, int16_t h) {
+    (void)x;
+    (void)y;
+    (void)w;
+    (void)h;
+  }
+  /*!
+      @brief   Receive one scanline of the image. These usually arrive
+               top to bottom, but bottom to top for RLE BMPs (and others
+               read from a forward-only source), so use y.
+      @param   x       Horizontal position of first pixel.
+      @param   y       Vertical position of scanline.
+      @param   pixels  Pixels, in the reader's own buffer (not a copy):
+                       valid only until this function returns.
+      @param   count   Number of pixels.
+      @param   format  Pixel format, usually IMAGE_SINK_565.
+      @return  None (void).
+  */
+  virtual void row(int16_t x, int16_t y, const uint16_t *pixels,
+                   int16_t count, ImageSinkFormat format) = 0;
+  /*!
+      @brief   Called once after the last row() of an image.
+      @return  None (void).
+  */
+  virtual void end(void) {}
+};
+
+/*!
+   @brief  Adafruit_ImageSink drawing to any Adafruit_GFX object, e.g. a
+           display with a non-SPITFT library, or a GFXcanvas16 (such as a
+           framebuffer being composited) at any position in it.
+*/
+class Adafruit_ImageSinkGFX : public Adafruit_ImageSink {
+public:
+  Adafruit_ImageSinkGFX(Adafruit_GFX &gfx);
+  int16_t width(void);
+  int16_t height(void);
+  void row(int16_t x, int16_t y, const uint16_t *pixels, int16_t count,
+           ImageSinkFormat format);
+
+private:
+  Adafruit_GFX &gfx; ///< Display or canvas being drawn to
+};
+
+/*!
+   @brief  Many images in a single file (made with the imagepack.py script
+           in the 'extras' folder), opened once with ImageReader.openPack()
+           and kept open. The name index is kept in RAM, so finding an
+           image is a binary search instead of a filesystem open(), and
+           hundreds of images cost one file handle. select() an image by
+           name, then pass the pack (as an Adafruit_ImageSource, reading
+           that image) to drawBMP(), loadBMP() or drawRAW(). Not copyable
+           (owns its file and index), pass by reference.
+*/
+class Adafruit_ImagePack : public Adafruit_ImageSource {
+public:
+  Adafruit_ImagePack(void);
+  Adafruit_ImagePack(const Adafruit_ImagePack &) = delete; // Not copyable
+  Adafruit_ImagePack &operator=(const Adafruit_ImagePack &) = delete;
+  ~Adafruit_ImagePack(void);
+  void close(void);
+  int32_t find(const char *name) const;
+  boolean select(const char *name);
+  boolean select(uint16_t index);
+  const char *name(uint16_t index) const;
+  /*!
+      @brief   Return number of images in pack.
+      @return  Image count, 0 if not open.
+  */
+  uint16_t count(void) const { return entries; }
+  /*!
+      @brief   Return type of selected image.
+      @return  An ImagePackFormat value (IMAGE_PACK_OTHER if none
+               selected).
+  */
+  ImagePackFormat getFormat(void) const { return format; }
+  /*!
+      @brief   Return size of selected image.
+      @return  Size in bytes, 0 if none selected.
+  */
+  uint32_t size(void) const { return entrySize; }
+  int read(uint8_t *buf, uint32_t len);
+  boolean seek(uint32_t pos);
+  /*!
+      @brief   Return position within selected image.
+      @return  Byte offset from start of image.
+  */
+  uint32_t position(void) { return pos; }
+
+private:
+  File file;              ///< Pack file, open until close()
+  uint8_t *index;         ///< Entries then names, as in file (or NULL)
+  uint16_t entries;       ///< Number of entries in index
+  uint32_t base;          ///< File position of selected image
+  uint32_t entrySize;     ///< Size of same
+  uint32_t pos;           ///< Position within same
+  ImagePackFormat format; ///< Type of same
+  friend class Adafruit_ImageReader; ///< Opening occurs here
 };
 
 /*!
@@ -41,10 +370,15 @@ enum ImageFormat {
 class Adafruit_Image {
 public:
   Adafruit_Image(void);
+  Adafruit_Image(Adafruit_Image &&other);
+  Adafruit_Image &operator=(Adafruit_Image &&other);
   ~Adafruit_Image(void);
   int16_t width(void) const;  // Return image width in pixels
   int16_t height(void) const; // Return image height in pixels
   void draw(Adafruit_SPITFT &tft, int16_t x, int16_t y);
+  void draw(Adafruit_SPITFT &tft, int16_t x, int16_t y, int16_t srcX,
+            int16_t srcY, int16_t srcW, int16_t srcH);
+  uint32_t size(void) const; // Return RAM used by pixels & palette
   /*!
       @brief   Return canvas image format.
       @return  An ImageFormat type: IMAGE_1 for a GFXcanvas1, IMAGE_8 for
@@ -56,18 +390,20 @@ public:
   /*!
       @brief   Return pointer to color palette.
       @return  Pointer to an array of 16-bit color values, or NULL if no
-               palette associated with image.
+               palette associated with image. IMAGE_8 canvases contain
+               indices into this palette (16 or 256 entries).
   */
   uint16_t *getPalette(void) const { return palette; }
   /*!
       @brief   Return pointer to 1bpp image mask canvas.
       @return  GFXcanvas1* pointer (1-bit RAM-resident image) if present,
-               NULL otherwise.
+               NULL otherwise. 32-bit BMPs with an alpha channel get a
+               mask, same size as the image; set bits are opaque pixels
+               (alpha 128 or more), and only these are drawn.
   */
   GFXcanvas1 *getMask(void) const { return mask; };
 
 protected:
-  // MOST OF THESE ARE NOT SUPPORTED YET -- WIP
   union {                  // Single pointer, only one variant is used:
     GFXcanvas1 *canvas1;   ///< Canvas object if 1bpp format
     GFXcanvas8 *canvas8;   ///< Canvas object if 8bpp format
@@ -75,9 +411,117 @@ protected:
   } canvas;                ///< Union of different GFXcanvas types
   GFXcanvas1 *mask;        ///< 1bpp image mask (or NULL)
   uint16_t *palette;       ///< Color palette for 8bpp image (or NULL)
+  Adafruit_ImageAllocator *allocator; ///< Canvas & palette allocated with
+  uint16_t colors;         ///< Number of entries in palette
   uint8_t format;          ///< Canvas bundle type in use
   void dealloc(void);      ///< Free/deinitialize variables
+  void release(void);      ///< Deinitialize variables without freeing
   friend class Adafruit_ImageReader; ///< Loading occurs here
+  friend class Adafruit_ImageCache;  ///< Eviction occurs here
+  friend struct BMPCore;             ///< Decoding occurs here
+};
+
+/*!
+   @brief  Handle for a BMP image file whose header has been parsed by
+           ImageReader.openBMP(). It can then be drawn or loaded any
+           number of times with ImageReader.drawBMP() or loadBMP() without
+           re-opening the file and re-parsing the header each time, and
+           optionally keeps the file open in between. Not copyable (owns
+           its file and palette), pass by reference. If opened from an
+           Adafruit_ImageSource, that's read instead of a file and must
+           stay valid while the handle is used.
+*/
+class Adafruit_BMPInfo {
+public:
+  Adafruit_BMPInfo(void);
+  Adafruit_BMPInfo(const Adafruit_BMPInfo &) = delete; // Not copyable
+  Adafruit_BMPInfo &operator=(const Adafruit_BMPInfo &) = delete;
+  ~Adafruit_BMPInfo(void);
+  void close(void);
+  /*!
+      @brief   Return BMP image width.
+      @return  Width in pixels, or 0 if not open.
+  */
+  int32_t width(void) const { return bmpWidth; }
+  /*!
+      @brief   Return BMP image height.
+      @return  Height in pixels, or 0 if not open.
+  */
+  int32_t height(void) const { return bmpHeight; }
+  /*!
+      @brief   Return BMP image bit depth.
+      @return  Bits per pixel, or 0 if not open.
+  */
+  uint8_t getDepth(void) const { return depth; }
+
+protected:
+  File file;          ///< BMP file, if kept open
+  Adafruit_ImageSource *source; ///< Non-file source, else NULL
+  char *filename;     ///< Copy of filename, if file is not kept open
+  uint32_t offset;    ///< Start of image data in file
+  uint32_t rowSize;   ///< Bytes per scanline in file, incl. padding
+  int32_t bmpWidth;   ///< Image width in pixels
+  int32_t bmpHeight;  ///< Image height in pixels
+  uint16_t *palette;  ///< 16-bit 5/6/5 color palette (or NULL)
+  uint16_t colors;    ///< Number of entries in palette
+  uint8_t depth;      ///< Bits per pixel, 0 if not open
+  uint8_t compression; ///< 0 = none, 1 = RLE8, 2 = RLE4, 3 = bitfields,
+                       ///< 0xFF = QOI image
+  uint8_t maskShift[3]; ///< 16-bit R,G,B mask positions (LSB)
+  uint8_t maskBits[3];  ///< 16-bit R,G,B mask sizes (bits)
+  boolean rgb565;       ///< 16-bit data is 565, needs no conversion
+  boolean alpha;        ///< 32-bit data has alpha, loadBMP() makes mask
+  boolean flip;       ///< Image is stored bottom-to-top (normal BMP)
+  friend class Adafruit_ImageReader; ///< Parsing occurs here
+  friend struct BMPCore;             ///< Decoding occurs here
+};
+
+/*!
+   @brief  Progress of an incremental draw started by
+           ImageReader.beginDraw(): holds the open BMP image and the
+           decoder's state, which each step resumes from. Call step() or
+           stepMicros() repeatedly until done() returns true. Not copyable,
+           pass by reference.
+*/
+class Adafruit_BMPDraw {
+public:
+  Adafruit_BMPDraw(void);
+  Adafruit_BMPDraw(const Adafruit_BMPDraw &) = delete; // Not copyable
+  Adafruit_BMPDraw &operator=(const Adafruit_BMPDraw &) = delete;
+  ~Adafruit_BMPDraw(void);
+  ImageReturnCode step(uint16_t n = 1);
+  ImageReturnCode stepMicros(uint32_t us);
+  void cancel(void);
+  /*!
+      @brief   Check if incremental draw is finished.
+      @return  true if all rows are drawn, or draw was cancelled, failed or
+               never started; false if there are rows left to draw.
+  */
+  boolean done(void) const { return row >= rows; }
+  /*!
+      @brief   Return number of rows already drawn, e.g. for progress bar.
+      @return  Rows drawn so far (of those on screen).
+  */
+  int16_t rowsDone(void) const { return row; }
+  /*!
+      @brief   Return total number of rows to draw.
+      @return  Rows in image (as clipped to screen).
+  */
+  int16_t rowsTotal(void) const { return rows; }
+  /*!
+      @brief   Return result of the most recent step (or beginDraw()).
+      @return  One of the ImageReturnCode values.
+  */
+  ImageReturnCode getStatus(void) const { return status; }
+
+private:
+  Adafruit_ImageReader *reader; ///< Reader that began the draw
+  Adafruit_BMPInfo bmp;         ///< Open image
+  BMPCore *core;                ///< Decoding state (NULL if not drawing)
+  int16_t row;                  ///< Rows drawn, in output pixels
+  int16_t rows;                 ///< Rows to draw (row == rows when done)
+  ImageReturnCode status;       ///< Result of most recent step
+  friend class Adafruit_ImageReader; ///< beginDraw() occurs here
 };
 
 /*!
@@ -99,17 +543,183 @@ public:
   ImageReturnCode drawBMP(char *filename, Adafruit_SPITFT &tft, int16_t x,
                           int16_t y, boolean transact = true);
   ImageReturnCode loadBMP(char *filename, Adafruit_Image &img);
+  ImageReturnCode openBMP(const char *filename, Adafruit_BMPInfo &bmp,
+                          boolean keepOpen = true);
+  ImageReturnCode drawBMP(Adafruit_BMPInfo &bmp, Adafruit_SPITFT &tft,
+                          int16_t x, int16_t y, boolean transact = true);
+  ImageReturnCode loadBMP(Adafruit_BMPInfo &bmp, Adafruit_Image &img);
+  ImageReturnCode openBMP(Adafruit_ImageSource &source, Adafruit_BMPInfo &bmp);
+  ImageReturnCode drawBMP(Adafruit_ImageSource &source, Adafruit_SPITFT &tft,
+                          int16_t x, int16_t y, boolean transact = true);
+  ImageReturnCode loadBMP(Adafruit_ImageSource &source, Adafruit_Image &img);
+  ImageReturnCode openPack(const char *filename, Adafruit_ImagePack &pack);
+  ImageReturnCode drawBMP(char *filename, Adafruit_SPITFT &tft, int16_t x,
+                          int16_t y, int16_t srcX, int16_t srcY, int16_t srcW,
+                          int16_t srcH, boolean transact = true);
+  ImageReturnCode drawBMP(Adafruit_BMPInfo &bmp, Adafruit_SPITFT &tft,
+                          int16_t x, int16_t y, int16_t srcX, int16_t srcY,
+                          int16_t srcW, int16_t srcH, boolean transact = true);
+  ImageReturnCode loadBMP(char *filename, Adafruit_Image &img, int16_t srcX,
+                          int16_t srcY, int16_t srcW, int16_t srcH);
+  ImageReturnCode loadBMP(Adafruit_BMPInfo &bmp, Adafruit_Image &img,
+                          int16_t srcX, int16_t srcY, int16_t srcW,
+                          int16_t srcH);
+  ImageReturnCode beginDraw(const char *filename, Adafruit_SPITFT &tft,
+                            int16_t x, int16_t y, Adafruit_BMPDraw &draw,
+                            boolean transact = true);
+  ImageReturnCode drawBMP(char *filename, Adafruit_ImageSink &sink, int16_t x,
+                          int16_t y);
+  ImageReturnCode drawBMP(Adafruit_BMPInfo &bmp, Adafruit_ImageSink &sink,
+                          int16_t x, int16_t y);
+  ImageReturnCode drawBMP(const char *filename, Adafruit_EPD &epd, int16_t x,
+                          int16_t y, ImageDither dither = IMAGE_DITHER_NONE);
+  ImageReturnCode drawRAW(char *filename, Adafruit_SPITFT &tft, int16_t x,
+                          int16_t y, boolean transact = true);
+  ImageReturnCode drawRAW(Adafruit_ImageSource &source, Adafruit_SPITFT &tft,
+                          int16_t x, int16_t y, boolean transact = true);
+  ImageReturnCode drawRAW(const uint8_t *data, Adafruit_SPITFT &tft,
+                          int16_t x, int16_t y);
   ImageReturnCode bmpDimensions(char *filename, int32_t *w, int32_t *h);
   void printStatus(ImageReturnCode stat, Stream &stream = Serial);
+  /*!
+      @brief   Return statistics for the most recent drawBMP() or loadBMP()
+               call. Only filled in if compiled with IMAGEREADER_STATS.
+      @return  Adafruit_ImageStats, valid until the next call.
+  */
+  const Adafruit_ImageStats &getStats(void) const { return stats; }
+  void printStats(Stream &stream = Serial);
+  void setBufferRows(uint8_t rows);
+  void setBuffer(void *buf, uint32_t len);
+  void setDownscale(uint8_t shift, boolean average = false);
+  void setAllocator(Adafruit_ImageAllocator *a);
+  void setReuseCanvas(boolean reuse);
+#if defined(ESP32)
+  void setPipeline(int8_t core, uint8_t depth = 4);
+  ImageReturnCode prefetchBMP(const char *filename, Adafruit_Image &img,
+                              Adafruit_PrefetchCallback callback = NULL,
+                              void *arg = NULL, int8_t core = 0);
+  boolean prefetchDone(void);
+  ImageReturnCode prefetchWait(void);
+  void cancelPrefetch(void);
+  const uint8_t *mapPartition(const char *label, uint32_t offset = 0,
+                              uint32_t size = 0);
+  void unmapPartition(void);
+#endif
 
 private:
   fs::SPIFFSFS *filesys;
-  File file;
-  ImageReturnCode coreBMP(char *filename, Adafruit_SPITFT *tft, uint16_t *dest,
-                          int16_t x, int16_t y, Adafruit_Image *img,
-                          boolean transact);
-  uint16_t readLE16(void);
-  uint32_t readLE32(void);
+  uint8_t *userBuf;    ///< Application-supplied working buffer, or NULL
+  uint32_t userBufLen; ///< Size of userBuf in bytes
+  uint8_t bufRows;     ///< Scanlines to read at once if not cropped
+  Adafruit_ImageAllocator *allocator; ///< Canvas & working buffer memory
+  boolean reuseCanvas; ///< loadBMP() keeps image's canvas if it matches
+  uint8_t scaleShift;  ///< drawBMP()/loadBMP() downscale, 1 / 2^scaleShift
+  boolean scaleAvg;    ///< Box-average when downscaling, else point sample
+  Adafruit_ImageStats stats; ///< Last call's stats, if IMAGEREADER_STATS
+#if defined(ESP32)
+  int8_t pipeCore;   ///< Core for drawBMP() reader task, -1 = no pipeline
+  uint8_t pipeDepth; ///< Number of scanline buffers in reader task ring
+  uint32_t mapHandle; ///< mapPartition() handle (IDF mmap handles are 32-bit)
+  boolean mapped;     ///< Set if mapHandle is in use
+  void *prefetchSem;  ///< SemaphoreHandle_t, given when prefetch task ends
+  boolean prefetching;            ///< Prefetch task started, not yet waited
+  volatile boolean prefetchStop;  ///< Set by cancelPrefetch(), seen by load
+  ImageReturnCode prefetchStatus; ///< Result of prefetch task
+  char *prefetchName;             ///< Copy of filename being prefetched
+  Adafruit_Image *prefetchImg;    ///< Image being prefetched into
+  Adafruit_PrefetchCallback prefetchCallback; ///< Called when task ends
+  void *prefetchArg;                          ///< Passed to same
+  static void prefetchTask(void *arg);
+#endif
+  ImageReturnCode parseBMP(Adafruit_BMPInfo &bmp);
+  ImageReturnCode coreBMP(Adafruit_BMPInfo &bmp, Adafruit_SPITFT *tft,
+                          int16_t x, int16_t y, int16_t srcX, int16_t srcY,
+                          int16_t srcW, int16_t srcH, Adafruit_Image *img,
+                          boolean transact, Adafruit_ImageSink *sink = NULL);
+  ImageReturnCode beginBMP(BMPCore *&core, Adafruit_BMPInfo &bmp,
+                           Adafruit_SPITFT *tft, int16_t x, int16_t y,
+                           int16_t srcX, int16_t srcY, int16_t srcW,
+                           int16_t srcH, Adafruit_Image *img, int16_t band,
+                           boolean transact, int16_t *rows = NULL);
+  ImageReturnCode stepBMP(BMPCore *core, int16_t n, int16_t *top = NULL,
+                          int16_t *count = NULL);
+  ImageReturnCode endBMP(BMPCore *&core);
+  uint16_t readLE16(Adafruit_ImageSource &src);
+  uint32_t readLE32(Adafruit_ImageSource &src);
+  friend class Adafruit_BMPDraw; ///< Steps use stepBMP()
+  friend struct BMPCore;         ///< Uses reader's settings
+};
+
+/*!
+   @brief  Bounded cache of images loaded to RAM by an Adafruit_ImageReader,
+           keyed by filename. Images drawn repeatedly are read from the
+           filesystem and converted only the first time; after that,
+           drawing is a single RAM-to-display blit. A byte budget is
+           enforced by evicting the least recently used image. Not
+           copyable (owns its images), pass by reference.
+*/
+class Adafruit_ImageCache {
+public:
+  Adafruit_ImageCache(Adafruit_ImageReader &reader, uint32_t budget,
+                      uint8_t slots = 8);
+  Adafruit_ImageCache(const Adafruit_ImageCache &) = delete; // Not copyable
+  Adafruit_ImageCache &operator=(const Adafruit_ImageCache &) = delete;
+  ~Adafruit_ImageCache(void);
+  ImageReturnCode draw(const char *filename, Adafruit_SPITFT &tft, int16_t x,
+                       int16_t y);
+  Adafruit_Image *get(const char *filename, ImageReturnCode *status = NULL);
+  void remove(const char *filename);
+  void clear(void);
+  void setBudget(uint32_t bytes);
+  /*!
+      @brief   Return RAM used by cached images.
+      @return  Size in bytes of all cached images' pixels and palettes.
+  */
+  uint32_t bytesUsed(void) const { return used; }
+  /*!
+      @brief   Return number of get() or draw() calls that found the
+               image already in the cache.
+      @return  Hit count since construction or resetStats().
+  */
+  uint32_t hits(void) const { return hitCount; }
+  /*!
+      @brief   Return number of get() or draw() calls that had to load
+               the image (or failed to).
+      @return  Miss count since construction or resetStats().
+  */
+  uint32_t misses(void) const { return missCount; }
+  /*!
+      @brief   Return number of images removed from the cache, whether
+               evicted to make room or by remove(), clear() or
+               setBudget().
+      @return  Eviction count since construction or resetStats().
+  */
+  uint32_t evictions(void) const { return evictCount; }
+  void resetStats(void);
+
+private:
+  /*!
+     @brief  One cached image.
+  */
+  struct Entry {
+    Entry(void) : filename(NULL), bytes(0), lastUse(0) {}
+    char *filename;       ///< Copy of filename, NULL if slot is free
+    Adafruit_Image image; ///< Image loaded to RAM
+    uint32_t bytes;       ///< RAM used by image
+    uint32_t lastUse;     ///< Value of tick when last used
+  };
+  Adafruit_ImageReader *reader; ///< Images are loaded through this
+  Entry *entries;               ///< Array of numSlots cache entries
+  uint8_t numSlots;             ///< Maximum number of images in cache
+  uint32_t budget;              ///< Maximum RAM use in bytes
+  uint32_t used;                ///< Current RAM use in bytes
+  uint32_t tick;                ///< Incremented on every hit or load
+  uint32_t hitCount;            ///< Number of cache hits
+  uint32_t missCount;           ///< Number of cache misses
+  uint32_t evictCount;          ///< Number of evictions
+  Entry *find(const char *filename);
+  Entry *oldest(void);
+  void evict(Entry *e);
 };
 
 #endif // __ADAFRUIT_IMAGE_READER_H__
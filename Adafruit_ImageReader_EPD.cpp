@@ -1,5 +1,59 @@
 #include "Adafruit_ImageReader_EPD.h"
 
+// Infer closest ePaper color (black, white or red) for 8-bit R, G, B
+// (which may be outside 0-255 when dithering)
+static uint8_t epdColor(int16_t r, int16_t g, int16_t b) {
+  uint8_t c = 0;
+  if ((r < 0x80) && (g < 0x80) && (b < 0x80)) {
+    c = EPD_BLACK; // try to infer black
+  } else if ((r >= 0x80) && (g >= 0x80) && (b >= 0x80)) {
+    c = EPD_WHITE;
+  } else if (r >= 0x80) {
+    c = EPD_RED; // try to infer red color
+  }
+  return c;
+}
+
+// Infer closest ePaper color (black, white or red) for a 16-bit 565 color
+static uint8_t epdColor(uint16_t color) {
+  // RGB in 565 format
+  return epdColor((color & 0xf800) >> 8, (color & 0x07e0) >> 3,
+                  (color & 0x001f) << 3);
+}
+
+// 4x4 Bayer matrix for ordered dithering, as offsets added to each 8-bit
+// channel before thresholding: (index * 16) - 120, for -120 to +120.
+static const int8_t bayer[4][4] = {{-120, 8, -88, 40},
+                                   {72, -56, 104, -24},
+                                   {-72, 56, -104, 24},
+                                   {120, -8, 88, -40}};
+
+// Clip a w x h image at x, y to the ePaper display's bounds. x, y, w & h
+// are adjusted to the visible area (w or h <= 0 if none), and loadX,
+// loadY are set to the first visible pixel within the image.
+static void clipToEPD(Adafruit_EPD &epd, int16_t &x, int16_t &y, int &loadX,
+                      int &loadY, int &w, int &h) {
+  loadX = loadY = 0;
+  if (x < 0) {
+    loadX = -x;
+    w += x;
+    x = 0;
+  }
+  if (y < 0) {
+    loadY = -y;
+    h += y;
+    y = 0;
+  }
+  if ((x + w) > epd.width())
+    w = epd.width() - x;
+  if ((y + h) > epd.height())
+    h = epd.height() - y;
+}
+
+// Bytes of Floyd-Steinberg error terms for a visible width of w pixels:
+// R, G & B for each column, plus one more column (see render()).
+static uint32_t errBytes(int w) { return (w + 1) * 3 * sizeof(int16_t); }
+
 /*!
     @brief   Draw image to an Adafruit ePaper-type display.
     @param   epd
@@ -10,55 +64,269 @@
              the screen edges. Screen rotation setting is observed.
     @param   y
              Vertical offset in pixels; top edge = 0, positive = down.
+    @param   dither
+             How colors are reduced to ePaper black, white and red.
+             IMAGE_DITHER_NONE (default) thresholds each pixel, best for
+             line art and text. IMAGE_DITHER_ORDERED and
+             IMAGE_DITHER_DIFFUSION dither, for photos. Error diffusion
+             needs one scanline of working memory; if that can't be
+             allocated, ordered dithering is used instead.
+    @return  None (void).
+*/
+void Adafruit_Image_EPD::draw(Adafruit_EPD &epd, int16_t x, int16_t y,
+                              ImageDither dither) {
+  int16_t *err = NULL;
+  if (dither == IMAGE_DITHER_DIFFUSION) {
+    // Error terms are needed only for the visible width
+    int16_t cx = x, cy = y;
+    int w = width(), h = height(), loadX, loadY;
+    clipToEPD(epd, cx, cy, loadX, loadY, w, h);
+    if ((w > 0) && (h > 0) &&
+        (err = (int16_t *)allocator->alloc(errBytes(w), IMAGE_MEM_WORK)))
+      memset(err, 0, errBytes(w));
+  }
+  render(epd, x, y, dither, err);
+  if (err)
+    allocator->release(err, IMAGE_MEM_WORK);
+}
+
+/*!
+    @brief   Draw image to an Adafruit ePaper-type display, as draw(), but
+             with error terms supplied by the caller. Used by draw(), and
+             by ImageReader.drawBMP() to draw an image one band of
+             scanlines at a time, with error diffusion carrying on from
+             one band to the next.
+    @param   epd
+             Screen to draw to (any Adafruit_EPD-derived class).
+    @param   x
+             Horizontal offset in pixels, as draw().
+    @param   y
+             Vertical offset in pixels, as draw().
+    @param   dither
+             Color reduction, as draw().
+    @param   err
+             For IMAGE_DITHER_DIFFUSION, errBytes() worth of error terms
+             for the visible width, zeroed before the first scanline and
+             kept between calls (else ordered dithering is used). Ignored
+             for other dither modes, can be NULL.
+    @param   rows
+             Number of rows to draw from the top of the image, if fewer
+             than its height (e.g. last band of drawBMP() is short), or 0
+             for all.
     @return  None (void).
 */
-void Adafruit_Image_EPD::draw(Adafruit_EPD &epd, int16_t x, int16_t y) {
-  int16_t col = x, row = y;
-  if (format == IMAGE_1) {
-    uint8_t *buffer = canvas.canvas1->getBuffer();
-    uint8_t i, c;
-    while (row < y + canvas.canvas1->height()) {
-      for (i = 0; i < 8; i++) {
-        if ((*buffer & (0x80 >> i)) > 0) {
-          c = EPD_BLACK; // try to infer black
+void Adafruit_Image_EPD::render(Adafruit_EPD &epd, int16_t x, int16_t y,
+                                ImageDither dither, int16_t *err,
+                                int16_t rows) {
+  // Image is clipped to the screen once here, so no off-screen pixels
+  // are issued, and colors are converted to ePaper colors through a small
+  // table per draw rather than per pixel. Pixels still go through
+  // writePixel(): Adafruit_EPD's framebuffers aren't public, and their
+  // layout (and any external SRAM) is specific to each display driver,
+  // which its drawPixel() handles along with rotation.
+  if ((format == IMAGE_NONE) || ((format == IMAGE_8) && !palette))
+    return; // Nothing loaded (8-bit images always have a palette)
+  int w = width(), h = ((rows > 0) && (rows < height())) ? rows : height(),
+      loadX, loadY;
+  clipToEPD(epd, x, y, loadX, loadY, w, h);
+  if ((w <= 0) || (h <= 0))
+    return;
+  if ((dither == IMAGE_DITHER_DIFFUSION) && !err)
+    dither = IMAGE_DITHER_ORDERED; // No error terms, fall back
+  epd.startWrite();
+  if (dither != IMAGE_DITHER_NONE) {
+    // Each pixel is expanded to 565 color and to 8-bit R, G, B (the same
+    // way as undithered), then offset by the Bayer matrix or by diffused
+    // error before being thresholded.
+    for (int row = 0; row < h; row++) {
+      const int8_t *threshold = bayer[(y + row) & 3]; // Ordered: this row
+      int16_t carry[3] = {0, 0, 0}, // Diffusion: error to pixel at right,
+          below[3] = {0, 0, 0};     // and 1/16 to next row of same
+      int sy = loadY + row;
+      for (int col = 0; col < w; col++) {
+        int sx = loadX + col;
+        uint16_t color;
+        if (format == IMAGE_16) {
+          color = canvas.canvas16->getBuffer()[sy * width() + sx];
+        } else if (format == IMAGE_8) {
+          color = palette[canvas.canvas8->getBuffer()[sy * width() + sx]];
         } else {
-          c = EPD_WHITE;
+          uint8_t set = canvas.canvas1->getBuffer()[sy * ((width() + 7) / 8) +
+                                                    sx / 8] &
+                        (0x80 >> (sx & 7));
+          if (palette)
+            color = palette[set ? 1 : 0];
+          else
+            color = set ? 0x0000 : 0xFFFF; // Black on white
         }
-        epd.writePixel(col, row, c);
-
-        col++;
-        if (col == x + canvas.canvas1->width()) {
-          col = x;
-          row++;
+        int16_t rgb[3] = {(int16_t)((color & 0xf800) >> 8),
+                          (int16_t)((color & 0x07e0) >> 3),
+                          (int16_t)((color & 0x001f) << 3)};
+        uint8_t c;
+        if (dither == IMAGE_DITHER_ORDERED) {
+          int8_t t = threshold[(x + col) & 3];
+          c = epdColor(rgb[0] + t, rgb[1] + t, rgb[2] + t);
+        } else {
+          // Floyd-Steinberg, in one scanline of error terms. e[3-5] are
+          // R, G, B error for this pixel, from the row above; e[0-2] were
+          // read by the pixel at left and now collect the next row's
+          // error for it. The last column's spill to the right is lost.
+          int16_t *e = &err[col * 3];
+          for (uint8_t i = 0; i < 3; i++) {
+            rgb[i] += e[3 + i] + carry[i];
+            if (rgb[i] < 0) // Clamp, else out-of-gamut colors (which
+              rgb[i] = 0;   // no ePaper color is close to) build up
+            else if (rgb[i] > 255) // error without bound
+              rgb[i] = 255;
+          }
+          c = epdColor(rgb[0], rgb[1], rgb[2]);
+          for (uint8_t i = 0; i < 3; i++) {
+            // Error is value minus shown color; black is 0,0,0, red is
+            // 255,0,0 and anything else shows as white, 255,255,255.
+            int16_t shown =
+                ((c == EPD_BLACK) || ((c == EPD_RED) && i)) ? 0 : 255;
+            int16_t d = rgb[i] - shown;
+            e[i] += d * 3 / 16;               // Below left
+            e[3 + i] = d * 5 / 16 + below[i]; // Below
+            below[i] = d / 16;                // Below right
+            carry[i] = d * 7 / 16;            // Right
+          }
+        }
+        if (!mask || (mask->getBuffer()[sy * ((width() + 7) / 8) + sx / 8] &
+                      (0x80 >> (sx & 7)))) // Opaque (or no mask)
+          epd.writePixel(x + col, y + row, c);
+      }
+    }
+  } else if (format == IMAGE_1) {
+    // Set bits are palette[1], clear bits palette[0]; images without a
+    // palette are drawn black on white. Each canvas row starts on a byte
+    // boundary, whatever the image width.
+    uint8_t fg = EPD_BLACK, bg = EPD_WHITE;
+    if (palette) {
+      fg = epdColor(palette[1]);
+      bg = epdColor(palette[0]);
+    }
+    int stride = (canvas.canvas1->width() + 7) / 8;
+    uint8_t *src = &canvas.canvas1->getBuffer()[loadY * stride + loadX / 8];
+    for (int row = 0; row < h; row++, src += stride) {
+      uint8_t *p = src, bit = 0x80 >> (loadX & 7);
+      for (int col = 0; col < w; col++) {
+        epd.writePixel(x + col, y + row, (*p & bit) ? fg : bg);
+        if (!(bit >>= 1)) { // Next byte
+          bit = 0x80;
+          p++;
         }
       }
-      buffer++;
-    };
+    }
   } else if (format == IMAGE_8) {
+    uint8_t lut[256]; // Palette index to ePaper color
+    for (uint16_t i = 0; i < colors; i++)
+      lut[i] = epdColor(palette[i]);
+    int stride = canvas.canvas8->width();
+    uint8_t *src = &canvas.canvas8->getBuffer()[loadY * stride + loadX];
+    for (int row = 0; row < h; row++, src += stride) {
+      for (int col = 0; col < w; col++)
+        epd.writePixel(x + col, y + row, lut[src[col]]);
+    }
   } else if (format == IMAGE_16) {
-    uint16_t *buffer = canvas.canvas16->getBuffer();
-    while (row < y + canvas.canvas16->height()) {
-      // RGB in 565 format
-      uint8_t r = (*buffer & 0xf800) >> 8;
-      uint8_t g = (*buffer & 0x07e0) >> 3;
-      uint8_t b = (*buffer & 0x001f) << 3;
-
-      uint8_t c = 0;
-      if ((r < 0x80) && (g < 0x80) && (b < 0x80)) {
-        c = EPD_BLACK; // try to infer black
-      } else if ((r >= 0x80) && (g >= 0x80) && (b >= 0x80)) {
-        c = EPD_WHITE;
-      } else if (r >= 0x80) {
-        c = EPD_RED; // try to infer red color
+    // Set mask bits (if any) are opaque pixels, others are left as-is
+    int stride = canvas.canvas16->width(), maskStride = (stride + 7) / 8;
+    uint16_t *src = &canvas.canvas16->getBuffer()[loadY * stride + loadX];
+    uint8_t *bits = mask ? mask->getBuffer() : NULL;
+    for (int row = 0; row < h; row++, src += stride) {
+      for (int col = 0; col < w; col++) {
+        int sx = loadX + col;
+        if (!bits || (bits[(loadY + row) * maskStride + sx / 8] &
+                      (0x80 >> (sx & 7))))
+          epd.writePixel(x + col, y + row, epdColor(src[col]));
       }
+    }
+  }
+  epd.endWrite();
+}
 
-      epd.writePixel(col, row, c);
-      col++;
-      if (col == x + canvas.canvas16->width()) {
-        col = x;
-        row++;
-      }
-      buffer++;
-    };
+/*!
+    @brief   Loads BMP image file from SD card directly to ePaper display
+             (into its framebuffer, shown on the next display() call),
+             without loading the whole image to RAM first. The visible
+             part of the image is loaded a band of scanlines at a time
+             into a small canvas, which is drawn and then reused for the
+             next band. Downscaling (setDownscale()) and the allocator
+             (setAllocator()) apply as with loadBMP().
+    @param   filename
+             Name of BMP image file to load.
+    @param   epd
+             Adafruit_EPD object (any of the Adafruit ePaper displays).
+    @param   x
+             Horizontal offset in pixels; left edge = 0, positive = right.
+             Value is signed, image will be clipped if all or part is off
+             the screen edges. Screen rotation setting is observed.
+    @param   y
+             Vertical offset in pixels; top edge = 0, positive = down.
+    @param   dither
+             How colors are reduced to ePaper black, white and red, as
+             Adafruit_Image_EPD::draw(). Error diffusion carries on across
+             bands, so the result is the same as loading the whole image
+             and drawing it.
+    @return  One of the ImageReturnCode values (IMAGE_SUCCESS on successful
+             completion, other values on failure). IMAGE_ERR_MALLOC if
+             there isn't RAM for even one band.
+*/
+ImageReturnCode Adafruit_ImageReader::drawBMP(const char *filename,
+                                              Adafruit_EPD &epd, int16_t x,
+                                              int16_t y, ImageDither dither) {
+  Adafruit_BMPInfo bmp;
+  ImageReturnCode status = openBMP(filename, bmp);
+  if (status != IMAGE_SUCCESS)
+    return status;
+
+  // Clip (downscaled) image to screen; nothing visible is not an error
+  int w = bmp.bmpWidth >> scaleShift, h = bmp.bmpHeight >> scaleShift,
+      loadX, loadY;
+  clipToEPD(epd, x, y, loadX, loadY, w, h);
+  if ((w <= 0) || (h <= 0))
+    return IMAGE_SUCCESS;
+
+  // Bands of 8 output scanlines (fewer if the image is shorter), loaded
+  // into one band canvas that's drawn and then refilled. The decoder
+  // carries on from one band to the next, so each scanline is read
+  // once. Error diffusion terms (one scanline) are kept across bands,
+  // and if they can't be allocated, ordered dithering is used instead.
+  // RLE-compressed images decode bottom-up, but diffusion must go top
+  // down, so with both each band is instead decoded from the start of
+  // the stream (slower).
+  Adafruit_Image_EPD band;
+  int16_t *err = NULL;
+  if ((dither == IMAGE_DITHER_DIFFUSION) &&
+      (err = (int16_t *)allocator->alloc(errBytes(w), IMAGE_MEM_WORK)))
+    memset(err, 0, errBytes(w));
+  boolean reuse = reuseCanvas;
+  reuseCanvas = true;
+  if (err && ((bmp.compression == 1) || (bmp.compression == 2))) {
+    for (int row = 0; (row < h) && (status == IMAGE_SUCCESS); row += 8) {
+      int n = ((h - row) < 8) ? (h - row) : 8;
+      status = coreBMP(bmp, NULL, 0, 0, loadX << scaleShift,
+                       (loadY + row) << scaleShift, w << scaleShift,
+                       n << scaleShift, &band, false);
+      if (status == IMAGE_SUCCESS)
+        band.render(epd, x, y + row, dither, err);
+    }
+  } else {
+    BMPCore *core;
+    status = beginBMP(core, bmp, NULL, 0, 0, loadX << scaleShift,
+                      loadY << scaleShift, w << scaleShift, h << scaleShift,
+                      &band, 8, false);
+    for (int16_t top, count = 1; (status == IMAGE_SUCCESS) && count;) {
+      status = stepBMP(core, 8, &top, &count);
+      if ((status == IMAGE_SUCCESS) && count)
+        band.render(epd, x, y + top, dither, err, count);
+    }
+    ImageReturnCode s = endBMP(core);
+    if (status == IMAGE_SUCCESS)
+      status = s;
   }
+  reuseCanvas = reuse;
+  if (err)
+    allocator->release(err, IMAGE_MEM_WORK);
+  return status;
 }
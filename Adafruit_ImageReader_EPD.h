@@ -24,9 +24,12 @@
 */
 class Adafruit_Image_EPD : public Adafruit_Image {
 public:
-  void draw(Adafruit_EPD &epd, int16_t x, int16_t y);
+  void draw(Adafruit_EPD &epd, int16_t x, int16_t y,
+            ImageDither dither = IMAGE_DITHER_NONE);
 
 protected:
+  void render(Adafruit_EPD &epd, int16_t x, int16_t y, ImageDither dither,
+              int16_t *err, int16_t rows = 0);
   friend class Adafruit_ImageReader; ///< Loading occurs here
 };
 
@@ -0,0 +1,154 @@
+// Host-side benchmark for Adafruit_ImageReader: decodes every BMP in a
+// directory (the library's images/ by default) against a mock
+// Adafruit_SPITFT and an in-memory filesystem (see mock/), so decoder
+// changes can be measured without flashing a device. Times are host CPU
+// times, useful for comparing one build to another, not as an estimate
+// of microcontroller speed (and there's no SPI bus or SD card here at
+// all, so "transactions" and "reads" are counts, not costs). ESP32 is
+// not defined, so the ESP32-only paths (pipelined reads, PSRAM) aren't
+// built or measured.
+//
+// Build from the library's top directory:
+//   g++ -std=gnu++11 -O2 -Iextras/benchmark/mock -I. Adafruit_ImageReader.cpp
+//       extras/benchmark/benchmark.cpp -o imagebench
+// Run:
+//   ./imagebench [directory [repetitions]]
+//
+// For each image and mode, one line: best-of-repetitions time per output
+// pixel, then from the last repetition the filesystem read() calls and
+// average bytes per read, seeks, SPI transactions (startWrite() calls),
+// address windows, and a checksum of the output, which should only
+// change when decoding results are meant to. Modes:
+//   draw   drawBMP() at 0,0 on a screen the size of the image
+//   clip   drawBMP() clipped on all four sides, to the center quarter
+//   load   loadBMP() into RAM (checksum is of the canvas)
+// Add -DIMAGEREADER_STATS to the build to also print the library's own
+// breakdown of the last repetition (see ImageReader.printStats()).
+
+#include "Adafruit_ImageReader.h"
+#include <dirent.h>
+#include <string>
+#include <vector>
+
+Stream Serial;
+fs::SPIFFSFS SPIFFS;
+fs::Stats fs::stats;
+
+static uint32_t hashBytes(const void *p, size_t n) {
+  const uint8_t *b = (const uint8_t *)p;
+  uint32_t h = 2166136261u; // FNV-1a
+  while (n--)
+    h = (h ^ *b++) * 16777619u;
+  return h;
+}
+
+// Hash of a loaded image's pixels
+static uint32_t hashImage(const Adafruit_Image &img) {
+  uint32_t w = img.width(), h = img.height();
+  switch (img.getFormat()) {
+  case IMAGE_16:
+    return hashBytes(((GFXcanvas16 *)img.getCanvas())->getBuffer(), w * h * 2);
+  case IMAGE_8:
+    return hashBytes(((GFXcanvas8 *)img.getCanvas())->getBuffer(), w * h);
+  case IMAGE_1:
+    return hashBytes(((GFXcanvas1 *)img.getCanvas())->getBuffer(),
+                     ((w + 7) / 8) * h);
+  default:
+    return 0;
+  }
+}
+
+// Add every .bmp file in dir to SPIFFS, return their names, sorted
+static std::vector<std::string> addImages(const char *dir) {
+  std::vector<std::string> names;
+  DIR *d = opendir(dir);
+  if (!d)
+    return names;
+  for (struct dirent *e; (e = readdir(d));) {
+    std::string n = e->d_name;
+    if ((n.size() < 4) || (n.compare(n.size() - 4, 4, ".bmp")))
+      continue;
+    FILE *f = fopen((std::string(dir) + "/" + n).c_str(), "rb");
+    if (!f)
+      continue;
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    for (size_t len; (len = fread(buf, 1, sizeof buf, f));)
+      data.insert(data.end(), buf, buf + len);
+    fclose(f);
+    SPIFFS.add("/" + n, data);
+    names.push_back("/" + n);
+  }
+  closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+int main(int argc, char **argv) {
+  const char *dir = (argc > 1) ? argv[1] : "images";
+  int reps = (argc > 2) ? atoi(argv[2]) : 20;
+  if (reps < 1)
+    reps = 1;
+  std::vector<std::string> names = addImages(dir);
+  if (names.empty()) {
+    fprintf(stderr, "No .bmp files in %s\n", dir);
+    return 1;
+  }
+
+  Adafruit_ImageReader reader(SPIFFS);
+  const char *modes[] = {"draw", "clip", "load"};
+  double total[3] = {0, 0, 0}; // Sum of best times per mode, microseconds
+  printf("%-22s %9s %3s %-4s %4s %8s %7s %7s %6s %6s %7s %8s\n", "image",
+         "size", "bpp", "mode", "stat", "ns/pixel", "reads", "B/read",
+         "seeks", "trans", "windows", "checksum");
+  for (size_t i = 0; i < names.size(); i++) {
+    char *name = (char *)names[i].c_str();
+    Adafruit_BMPInfo bmp;
+    ImageReturnCode status = reader.openBMP(name, bmp);
+    int w = bmp.width(), h = bmp.height(), depth = bmp.getDepth();
+    bmp.close();
+    for (uint8_t m = 0; m < 3; m++) {
+      // Screen the size of the image, or half the size if clipping
+      Adafruit_SPITFT tft(m == 1 ? w / 2 : w, m == 1 ? h / 2 : h);
+      int16_t x = (m == 1) ? -w / 4 : 0, y = (m == 1) ? -h / 4 : 0;
+      unsigned long pixels = (unsigned long)tft.width() * tft.height();
+      double best = 0;
+      uint32_t checksum = 0;
+      fs::Stats fsStats;
+      for (int r = 0; r < reps; r++) {
+        Adafruit_Image img;
+        tft.reset();
+        memset(&fs::stats, 0, sizeof fs::stats);
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        if (m < 2)
+          status = reader.drawBMP(name, tft, x, y);
+        else
+          status = reader.loadBMP(name, img);
+        double us = std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        if (!r || (us < best))
+          best = us;
+        fsStats = fs::stats;
+        checksum = tft.checksum;
+        if (m == 2)
+          checksum = (status == IMAGE_SUCCESS) ? hashImage(img) : 0;
+      }
+      total[m] += best;
+      printf("%-22s %4dx%-4d %3d %-4s %4d %8.2f %7lu %7.1f %6lu %6lu %7lu "
+             "%08x\n",
+             name + 1, w, h, depth, modes[m], (int)status,
+             best * 1000.0 / pixels, fsStats.reads,
+             fsStats.reads ? (double)fsStats.readBytes / fsStats.reads : 0.0,
+             fsStats.seeks, tft.stats.startWrites, tft.stats.windows,
+             checksum);
+#if defined(IMAGEREADER_STATS)
+      reader.printStats();
+#endif
+    }
+  }
+  printf("total us, best of %d: draw %.0f, clip %.0f, load %.0f\n", reps,
+         total[0], total[1], total[2]);
+  return 0;
+}
@@ -0,0 +1,91 @@
+// Host stand-in for Adafruit_GFX: the base class and the three canvas
+// types, with just the members Adafruit_ImageReader uses. See
+// ../benchmark.cpp.
+#ifndef __BENCH_GFX_H__
+#define __BENCH_GFX_H__
+
+#include "Arduino.h"
+
+class Adafruit_GFX : public Print {
+public:
+  Adafruit_GFX(int16_t w, int16_t h)
+      : WIDTH(w), HEIGHT(h), _width(w), _height(h), rotation(0) {}
+  virtual ~Adafruit_GFX(void) {}
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+  virtual void startWrite(void) {}
+  virtual void endWrite(void) {}
+  virtual void writePixel(int16_t x, int16_t y, uint16_t color) {
+    drawPixel(x, y, color);
+  }
+  void drawBitmap(int16_t x, int16_t y, uint8_t *bitmap, int16_t w, int16_t h,
+                  uint16_t color, uint16_t bg) {
+    int16_t bw = (w + 7) / 8;
+    startWrite();
+    for (int16_t j = 0; j < h; j++)
+      for (int16_t i = 0; i < w; i++)
+        writePixel(x + i, y + j,
+                   (bitmap[j * bw + i / 8] & (0x80 >> (i & 7))) ? color : bg);
+    endWrite();
+  }
+  void drawRGBBitmap(int16_t x, int16_t y, uint16_t *bitmap, int16_t w,
+                     int16_t h) {
+    startWrite();
+    for (int16_t j = 0; j < h; j++)
+      for (int16_t i = 0; i < w; i++)
+        writePixel(x + i, y + j, bitmap[j * w + i]);
+    endWrite();
+  }
+  int16_t width(void) const { return _width; }
+  int16_t height(void) const { return _height; }
+  uint8_t getRotation(void) const { return rotation; }
+  void setRotation(uint8_t r) {
+    rotation = r & 3;
+    _width = (rotation & 1) ? HEIGHT : WIDTH;
+    _height = (rotation & 1) ? WIDTH : HEIGHT;
+  }
+  size_t write(uint8_t c) {
+    (void)c;
+    return 1;
+  }
+
+protected:
+  int16_t WIDTH, HEIGHT, _width, _height;
+  uint8_t rotation;
+};
+
+// Canvas of pixel type T; B is bits per pixel. Rows of 1-bit canvases
+// start on a byte boundary.
+template <typename T, uint8_t B> class BenchCanvas : public Adafruit_GFX {
+public:
+  BenchCanvas(uint16_t w, uint16_t h, bool allocate_buffer = true)
+      : Adafruit_GFX(w, h), buffer(NULL), buffer_owned(allocate_buffer) {
+    if (allocate_buffer)
+      buffer = (T *)calloc(stride() * h, sizeof(T));
+  }
+  ~BenchCanvas(void) {
+    if (buffer_owned)
+      free(buffer);
+  }
+  void drawPixel(int16_t x, int16_t y, uint16_t color) {
+    if ((x < 0) || (y < 0) || (x >= WIDTH) || (y >= HEIGHT))
+      return;
+    if (B == 1) {
+      uint8_t *p = (uint8_t *)&buffer[y * stride() + x / 8];
+      *p = color ? (*p | (0x80 >> (x & 7))) : (*p & ~(0x80 >> (x & 7)));
+    } else {
+      buffer[y * stride() + x] = color;
+    }
+  }
+  T *getBuffer(void) const { return buffer; }
+
+protected:
+  uint32_t stride(void) const { return (B == 1) ? (WIDTH + 7) / 8 : WIDTH; }
+  T *buffer;
+  bool buffer_owned;
+};
+
+typedef BenchCanvas<uint8_t, 1> GFXcanvas1;
+typedef BenchCanvas<uint8_t, 8> GFXcanvas8;
+typedef BenchCanvas<uint16_t, 16> GFXcanvas16;
+
+#endif // __BENCH_GFX_H__
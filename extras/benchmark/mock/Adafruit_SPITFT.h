@@ -0,0 +1,58 @@
+// Host stand-in for Adafruit_SPITFT. Nothing is displayed: pixels are
+// folded into a checksum (so a change to the decoder that alters output
+// shows up) and bus activity is counted. See ../benchmark.cpp.
+#ifndef __BENCH_SPITFT_H__
+#define __BENCH_SPITFT_H__
+
+#include "Adafruit_GFX.h"
+
+class Adafruit_SPITFT : public Adafruit_GFX {
+public:
+  /** Bus activity, reset by the benchmark before each draw */
+  struct Stats {
+    unsigned long startWrites; // startWrite() calls (SPI transactions)
+    unsigned long windows;     // setAddrWindow() calls
+    unsigned long writes;      // writePixels() calls
+    unsigned long pixels;      // Pixels via writePixels() or writePixel()
+    unsigned long dmaWaits;    // dmaWait() calls
+  };
+  Adafruit_SPITFT(uint16_t w, uint16_t h) : Adafruit_GFX(w, h) { reset(); }
+  void reset(void) {
+    memset(&stats, 0, sizeof stats);
+    checksum = 0;
+  }
+  void drawPixel(int16_t x, int16_t y, uint16_t color) {
+    startWrite();
+    writePixel(x, y, color);
+    endWrite();
+  }
+  void writePixel(int16_t x, int16_t y, uint16_t color) {
+    if ((x < 0) || (y < 0) || (x >= _width) || (y >= _height))
+      return;
+    stats.pixels++;
+    checksum = (checksum * 31) ^ (y * _width + x) ^ ((uint32_t)color << 16);
+  }
+  void startWrite(void) { stats.startWrites++; }
+  void endWrite(void) {}
+  void setAddrWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    stats.windows++;
+    checksum = (checksum * 31) ^ x ^ (y << 8) ^ (w << 16) ^ (h << 24);
+  }
+  void writePixels(uint16_t *colors, uint32_t len, bool block = true,
+                   bool bigEndian = false) {
+    (void)block;
+    stats.writes++;
+    stats.pixels += len;
+    while (len--) {
+      uint16_t c = *colors++;
+      if (bigEndian)
+        c = (c >> 8) | (c << 8);
+      checksum = (checksum * 31) ^ c;
+    }
+  }
+  void dmaWait(void) { stats.dmaWaits++; }
+  Stats stats;       ///< Bus activity since reset()
+  uint32_t checksum; ///< Hash of windows and pixels since reset()
+};
+
+#endif // __BENCH_SPITFT_H__
@@ -0,0 +1,85 @@
+// Host stand-in for the Arduino core: just the types, timing and Print /
+// Stream classes that Adafruit_ImageReader uses. See ../benchmark.cpp.
+#ifndef __BENCH_ARDUINO_H__
+#define __BENCH_ARDUINO_H__
+
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+#define DEC 10
+#define HEX 16
+using std::max;
+using std::min;
+
+inline void yield(void) {}
+inline unsigned long micros(void) {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+inline unsigned long millis(void) { return micros() / 1000; }
+
+// Output goes to stdout
+class Print {
+public:
+  virtual ~Print(void) {}
+  virtual size_t write(uint8_t c) { return fputc(c, stdout) != EOF; }
+  size_t print(const char *s) {
+    size_t n = 0;
+    while (*s)
+      n += write(*s++);
+    return n;
+  }
+  size_t print(const __FlashStringHelper *s) { return print((const char *)s); }
+  size_t print(char c) { return write(c); }
+  size_t print(unsigned long n, int base = DEC) {
+    char buf[24];
+    snprintf(buf, sizeof buf, (base == HEX) ? "%lX" : "%lu", n);
+    return print(buf);
+  }
+  size_t print(long n, int base = DEC) {
+    if ((n < 0) && (base == DEC))
+      return write('-') + print((unsigned long)-n);
+    return print((unsigned long)n, base);
+  }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) {
+    return print((unsigned long)n, base);
+  }
+  size_t print(double d, int digits = 2) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.*f", digits, d);
+    return print(buf);
+  }
+  size_t println(void) { return print("\r\n"); }
+  template <typename T> size_t println(T v) { return print(v) + println(); }
+  template <typename T> size_t println(T v, int base) {
+    return print(v, base) + println();
+  }
+};
+
+// Input side is just enough for Adafruit_ImageStream: read() a byte,
+// readBytes() without waiting (no timeout on the host).
+class Stream : public Print {
+public:
+  virtual int available(void) { return 0; }
+  virtual int read(void) { return -1; }
+  size_t readBytes(char *buf, size_t len) {
+    size_t n = 0;
+    int c;
+    while ((n < len) && ((c = read()) >= 0))
+      buf[n++] = c;
+    return n;
+  }
+  void setTimeout(unsigned long ms) { (void)ms; }
+};
+extern Stream Serial;
+
+#endif // __BENCH_ARDUINO_H__
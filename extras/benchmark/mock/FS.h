@@ -0,0 +1,101 @@
+// Host stand-in for the Arduino FS layer: files live in memory, and every
+// open, read and seek is counted (fs::stats) so the benchmark can report
+// filesystem traffic per draw. See ../benchmark.cpp.
+#ifndef __BENCH_FS_H__
+#define __BENCH_FS_H__
+
+#include "Arduino.h"
+#include <map>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+/** Filesystem traffic, reset by the benchmark before each draw */
+struct Stats {
+  unsigned long opens;     // Successful open() calls
+  unsigned long reads;     // read() calls, single-byte or block
+  unsigned long readBytes; // Bytes returned by all read() calls
+  unsigned long seeks;     // seek() calls
+};
+extern Stats stats;
+
+class File : public Stream {
+public:
+  File(void) : data(NULL), pos(0) {}
+  File(const std::vector<uint8_t> *d) : data(d), pos(0) {}
+  int read(void) {
+    stats.reads++;
+    if (!data || (pos >= data->size()))
+      return -1;
+    stats.readBytes++;
+    return (*data)[pos++];
+  }
+  size_t read(uint8_t *buf, size_t len) {
+    stats.reads++;
+    if (!data || (pos >= data->size()))
+      return 0;
+    if (len > (data->size() - pos))
+      len = data->size() - pos;
+    memcpy(buf, &(*data)[pos], len);
+    pos += len;
+    stats.readBytes += len;
+    return len;
+  }
+  bool seek(uint32_t p, SeekMode mode = SeekSet) {
+    stats.seeks++;
+    if (!data)
+      return false;
+    if (mode == SeekCur)
+      p += pos;
+    else if (mode == SeekEnd)
+      p += data->size();
+    if (p > data->size())
+      return false;
+    pos = p;
+    return true;
+  }
+  size_t position(void) const { return pos; }
+  size_t size(void) const { return data ? data->size() : 0; }
+  int available(void) { return data ? (int)(data->size() - pos) : 0; }
+  void close(void) {
+    data = NULL;
+    pos = 0;
+  }
+  operator bool() const { return data != NULL; }
+
+private:
+  const std::vector<uint8_t> *data; // File contents, owned by FS
+  size_t pos;                       // Read position
+};
+
+class FS {
+public:
+  File open(const char *path, const char *mode = FILE_READ) {
+    (void)mode;
+    std::map<std::string, std::vector<uint8_t> >::const_iterator it =
+        files.find(path);
+    if (it == files.end())
+      return File();
+    stats.opens++;
+    return File(&it->second);
+  }
+  bool exists(const char *path) { return files.count(path) > 0; }
+  /** Add (or replace) a file */
+  void add(const std::string &path, const std::vector<uint8_t> &contents) {
+    files[path] = contents;
+  }
+
+private:
+  std::map<std::string, std::vector<uint8_t> > files;
+};
+
+} // namespace fs
+
+using fs::File;
+
+#endif // __BENCH_FS_H__
@@ -0,0 +1,19 @@
+// Host stand-in for the ESP32 SPIFFS filesystem, see FS.h.
+#ifndef __BENCH_SPIFFS_H__
+#define __BENCH_SPIFFS_H__
+
+#include "FS.h"
+
+namespace fs {
+class SPIFFSFS : public FS {
+public:
+  bool begin(bool formatOnFail = false) {
+    (void)formatOnFail;
+    return true;
+  }
+};
+} // namespace fs
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif // __BENCH_SPIFFS_H__
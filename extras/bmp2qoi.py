@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""
+Convert BMP images to QOI ("Quite OK Image", qoiformat.org), which
+Adafruit_ImageReader::drawBMP() and loadBMP() also accept. QOI is
+lossless and often much smaller than a 24-bit BMP, so less has to be
+read from the card (or flash); the microcontroller decodes it in one pass
+with a small table of recently seen colors.
+
+Handles the same BMPs as bmp2raw.py (uncompressed 1-, 4-, 8-, 16-, 24-
+and 32-bit), always writing 3-channel (RGB) QOI. Pixels are kept at full
+8 bits per channel and reduced to 565 on the microcontroller, the same as
+for the BMP, so both look identical.
+
+Usage: bmp2qoi.py input.bmp [output.qoi]
+       (output name defaults to input name with .qoi extension)
+"""
+
+import os
+import struct
+import sys
+
+from bmp2raw import read_bmp
+
+
+def encode_qoi(width, height, rows):
+    """Return QOI file data for a top-to-bottom list of rows of (r, g, b)
+    tuples, 3 channels, sRGB."""
+    out = bytearray(struct.pack(">4sIIBB", b"qoif", width, height, 3, 0))
+    index = [(0, 0, 0, 0)] * 64
+    prev = (0, 0, 0, 255)
+    run = 0
+    for row in rows:
+        for (r, g, b) in row:
+            px = (r, g, b, 255)
+            if px == prev:
+                run += 1
+                if run == 62:
+                    out.append(0xC0 | (run - 1))  # QOI_OP_RUN
+                    run = 0
+                continue
+            if run:
+                out.append(0xC0 | (run - 1))
+                run = 0
+            pos = (r * 3 + g * 5 + b * 7 + 255 * 11) & 63
+            if index[pos] == px:
+                out.append(pos)  # QOI_OP_INDEX
+            else:
+                index[pos] = px
+                dr = (r - prev[0] + 128) % 256 - 128  # Wrap to -128..127
+                dg = (g - prev[1] + 128) % 256 - 128
+                db = (b - prev[2] + 128) % 256 - 128
+                if -2 <= dr <= 1 and -2 <= dg <= 1 and -2 <= db <= 1:
+                    out.append(0x40 | (dr + 2) << 4 | (dg + 2) << 2 |
+                               (db + 2))  # QOI_OP_DIFF
+                elif (-32 <= dg <= 31 and -8 <= dr - dg <= 7 and
+                      -8 <= db - dg <= 7):
+                    out.append(0x80 | (dg + 32))  # QOI_OP_LUMA
+                    out.append((dr - dg + 8) << 4 | (db - dg + 8))
+                else:
+                    out += bytes((0xFE, r, g, b))  # QOI_OP_RGB
+            prev = px
+    if run:
+        out.append(0xC0 | (run - 1))
+    out += b"\0" * 7 + b"\1"  # End marker
+    return out
+
+
+def main(argv):
+    if len(argv) not in (2, 3):
+        sys.exit(__doc__)
+    src = argv[1]
+    dst = argv[2] if len(argv) == 3 else os.path.splitext(src)[0] + ".qoi"
+    width, height, rows = read_bmp(src)
+    if width > 0x7FFF or height > 0x7FFF:
+        sys.exit("image too large")
+    with open(dst, "wb") as f:
+        f.write(encode_qoi(width, height, rows))
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+Convert BMP images to the "panel-native" raw format drawn by
+Adafruit_ImageReader::drawRAW(). Pixels are converted to 16-bit 565 color
+here, on the host, and stored in the display's byte order (big-endian by
+default), so the microcontroller only has to read and issue them.
+
+Handles uncompressed 1-, 4-, 8-, 16-, 24- and 32-bit BMPs. Color is
+reduced to 565 the same way drawBMP() does it, so a raw image looks
+identical to the BMP it was made from.
+
+Raw file layout (header values little-endian):
+  2 bytes  signature, ASCII 'RW'
+  2 bytes  width in pixels
+  2 bytes  height in pixels
+  1 byte   pixel format, 1 = 16-bit 565 color
+  1 byte   pixel byte order, 0 = little-endian, 1 = big-endian
+  width * height pixels, top-to-bottom, no row padding
+
+Usage: bmp2raw.py [--little-endian] input.bmp [output.raw]
+       (output name defaults to input name with .raw extension)
+"""
+
+import os
+import struct
+import sys
+
+
+def read_bmp(path):
+    """Return (width, height, rows) where rows is a top-to-bottom list of
+    lists of (r, g, b) tuples."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[0:2] != b"BM":
+        raise ValueError("not a BMP file")
+    offset, = struct.unpack_from("<I", data, 10)
+    header_size, = struct.unpack_from("<I", data, 14)
+    if header_size == 12:  # OS/2 BITMAPCOREHEADER
+        width, height, planes, depth = struct.unpack_from("<hhHH", data, 18)
+        compression, colors = 0, 0
+        entry = 3
+    else:
+        width, height, planes, depth, compression = struct.unpack_from(
+            "<iiHHI", data, 18)
+        colors, = struct.unpack_from("<I", data, 46)
+        entry = 4
+    if planes != 1 or compression not in (0, 3):
+        raise ValueError("compressed BMPs are not supported")
+    flip = height > 0
+    height = abs(height)
+
+    palette = []
+    if depth <= 8:
+        count = colors or (1 << depth)
+        base = 14 + header_size
+        for i in range(count):
+            b, g, r = data[base + i * entry:base + i * entry + 3]
+            palette.append((r, g, b))
+        palette += [(0, 0, 0)] * ((1 << depth) - len(palette))
+
+    if depth == 16:
+        masks = (0x7C00, 0x03E0, 0x001F)
+        if compression == 3:
+            masks = struct.unpack_from("<III", data, 54)
+    elif depth == 32:
+        masks = (0xFF0000, 0x00FF00, 0x0000FF)
+        if compression == 3:
+            masks = struct.unpack_from("<III", data, 54)
+
+    def field(value, mask):
+        # Extract a mask field, scaled to 8 bits by repeating its bits
+        shift = (mask & -mask).bit_length() - 1
+        bits = bin(mask).count("1")
+        v = (value & mask) >> shift
+        if bits >= 8:
+            return v >> (bits - 8)
+        v <<= 8 - bits
+        b = bits
+        while b < 8:
+            v |= v >> b
+            b += bits
+        return v & 0xFF
+
+    row_size = ((depth * width + 31) // 32) * 4
+    rows = []
+    for y in range(height):
+        pos = offset + (height - 1 - y if flip else y) * row_size
+        line = data[pos:pos + row_size]
+        row = []
+        for x in range(width):
+            if depth == 24:
+                b, g, r = line[x * 3:x * 3 + 3]
+                row.append((r, g, b))
+            elif depth in (16, 32):
+                size = depth // 8
+                v = int.from_bytes(line[x * size:x * size + size], "little")
+                row.append(tuple(field(v, m) for m in masks))
+            else:
+                bit = x * depth
+                v = (line[bit // 8] >> (8 - depth - (bit & 7))) & (
+                    (1 << depth) - 1)
+                row.append(palette[v])
+        rows.append(row)
+    return width, height, rows
+
+
+def write_raw(path, width, height, rows, big_endian=True):
+    out = bytearray(struct.pack("<2sHHBB", b"RW", width, height, 1,
+                                1 if big_endian else 0))
+    fmt = ">H" if big_endian else "<H"
+    for row in rows:
+        for (r, g, b) in row:
+            out += struct.pack(fmt, ((r & 0xF8) << 8) | ((g & 0xFC) << 3) |
+                               (b >> 3))
+    with open(path, "wb") as f:
+        f.write(out)
+
+
+def main(argv):
+    big_endian = True
+    if "--little-endian" in argv:
+        argv.remove("--little-endian")
+        big_endian = False
+    if len(argv) not in (2, 3):
+        sys.exit(__doc__)
+    src = argv[1]
+    dst = argv[2] if len(argv) == 3 else os.path.splitext(src)[0] + ".raw"
+    width, height, rows = read_bmp(src)
+    if width > 0xFFFF or height > 0xFFFF:
+        sys.exit("image too large")
+    write_raw(dst, width, height, rows, big_endian)
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Pack many image files (BMP, QOI, or raw from bmp2raw.py) into a single
+image pack file for Adafruit_ImageReader::openPack(). The microcontroller
+then opens one file, once, keeps its index of names in RAM and seeks
+straight to each image, rather than opening a file per image (slow with
+many files on SPIFFS, which also wastes a page or more on each small
+file).
+
+Images are named by their path relative to the directory they were found
+in (or just file name, if given individually), with '/' separators and no
+leading slash, e.g. "icons/wifi.bmp". Use these names with
+Adafruit_ImagePack::select(). Files of other types are packed too, with
+type 0 (IMAGE_PACK_OTHER).
+
+Pack file layout (multi-byte values little-endian):
+  4 bytes  signature, ASCII 'IPAK'
+  2 bytes  version, 1
+  2 bytes  number of images
+  4 bytes  size of name table in bytes
+  4 bytes  reserved, 0
+  12 bytes per image, sorted by name (byte order):
+    4 bytes  position of image in pack file
+    4 bytes  size of image in bytes
+    2 bytes  position of name in name table
+    1 byte   type, 0 = other, 1 = BMP or QOI, 2 = raw
+    1 byte   reserved, 0
+  name table, NUL-terminated names, same order
+  images, each starting on a 4-byte boundary
+
+Usage: imagepack.py output.pak input [input ...]
+       (each input is an image file or a directory of them, searched
+       recursively for .bmp, .qoi and .raw files)
+       imagepack.py --list input.pak
+"""
+
+import os
+import struct
+import sys
+
+HEADER = "<4sHHII"
+ENTRY = "<IIHBB"
+TYPES = {b"BM": 1, b"qo": 1, b"RW": 2}
+
+
+def collect(inputs):
+    """Return sorted list of (name, path) for all input files."""
+    found = {}
+    for item in inputs:
+        if os.path.isdir(item):
+            for root, dirs, files in os.walk(item):
+                dirs.sort()
+                for f in sorted(files):
+                    ext = os.path.splitext(f)[1].lower()
+                    if ext in (".bmp", ".qoi", ".raw"):
+                        path = os.path.join(root, f)
+                        name = os.path.relpath(path, item)
+                        found[name.replace(os.sep, "/")] = path
+        else:
+            found[os.path.basename(item)] = item
+    return sorted(found.items(), key=lambda e: e[0].encode("utf-8"))
+
+
+def write_pack(path, images):
+    if len(images) > 0xFFFF:
+        sys.exit("too many images")
+    names = bytearray()
+    name_pos = []
+    for name, _ in images:
+        name_pos.append(len(names))
+        names += name.encode("utf-8") + b"\0"
+    if len(names) > 0x10000:
+        sys.exit("names too long")
+    pos = struct.calcsize(HEADER) + len(images) * struct.calcsize(ENTRY)
+    pos += len(names)
+    index = bytearray()
+    data = bytearray()
+    for (name, src), npos in zip(images, name_pos):
+        with open(src, "rb") as f:
+            payload = f.read()
+        while (pos + len(data)) & 3:
+            data.append(0)
+        index += struct.pack(ENTRY, pos + len(data), len(payload), npos,
+                             TYPES.get(payload[0:2], 0), 0)
+        data += payload
+    with open(path, "wb") as f:
+        f.write(struct.pack(HEADER, b"IPAK", 1, len(images), len(names), 0))
+        f.write(index + names + data)
+
+
+def list_pack(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    sig, version, count, names_size, _ = struct.unpack_from(HEADER, data)
+    if sig != b"IPAK" or version != 1:
+        sys.exit("not an image pack")
+    base = struct.calcsize(HEADER)
+    names = base + count * struct.calcsize(ENTRY)
+    for i in range(count):
+        pos, size, npos, kind, _ = struct.unpack_from(
+            ENTRY, data, base + i * struct.calcsize(ENTRY))
+        end = data.index(b"\0", names + npos)
+        name = data[names + npos:end].decode("utf-8")
+        kind = ("other", "bmp", "raw")[kind if kind <= 2 else 0]
+        print("%8d %8d  %-5s %s" % (pos, size, kind, name))
+
+
+def main(argv):
+    if len(argv) == 3 and argv[1] == "--list":
+        list_pack(argv[2])
+    elif len(argv) >= 3:
+        write_pack(argv[1], collect(argv[2:]))
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main(sys.argv)